@@ -23,6 +23,7 @@
 #include "codec_internal.h"
 
 #include "window.h"
+#include "mdct.h"
 #include "registry.h"
 #include "misc.h"
 
@@ -74,35 +75,160 @@ static int ilog(unsigned int v){
 			  |beginW
 */
 
+/* allocation *********************************************************/
+
+void *_vorbis_malloc(const vorbis_allocator *a,long bytes){
+  if(a && a->alloc)return(a->alloc(a->ctx,bytes));
+  return(_ogg_malloc(bytes));
+}
+
+void _vorbis_free(const vorbis_allocator *a,void *ptr){
+  if(!ptr)return;
+  if(a && a->alloc)
+    a->free(a->ctx,ptr);
+  else
+    _ogg_free(ptr);
+}
+
+/* each chunk starts with a pointer to the one before it */
+#define ARENA_HEADER ((long)((sizeof(void *)+WORD_ALIGN-1)&~(WORD_ALIGN-1)))
+#define ARENA_CHUNK  16384
+
+void _vorbis_arena_init(vorbis_arena *arena,const vorbis_allocator *allocator){
+  memset(arena,0,sizeof(*arena));
+  if(allocator)arena->allocator=*allocator;
+}
+
+/* starts a chunk of exactly bytes, for an arena whose size is known
+   ahead of time.  Whatever was left of the previous chunk is given up. */
+int _vorbis_arena_reserve(vorbis_arena *arena,long bytes){
+  char *chunk=_vorbis_malloc(&arena->allocator,ARENA_HEADER+bytes);
+  if(!chunk)return(-1);
+  *(void **)chunk=arena->chunks;
+  arena->chunks=chunk;
+  arena->top=chunk+ARENA_HEADER;
+  arena->left=bytes;
+  arena->size+=ARENA_HEADER+bytes;
+  return(0);
+}
+
+/* as _vorbis_arena_reserve(), but carves from the caller's buffer,
+   which must be WORD_ALIGN aligned and is never freed by the arena */
+void _vorbis_arena_use(vorbis_arena *arena,void *buffer,long bytes){
+  arena->top=buffer;
+  arena->left=bytes;
+  arena->size+=bytes;
+}
+
+/* returns zeroed storage, or NULL if the allocator fails */
+void *_vorbis_arena_alloc(vorbis_arena *arena,long bytes){
+  void *ret;
+  bytes=ARENA_BYTES(bytes);
+  if(bytes>arena->left){
+    /* a request too large for a chunk of its own size gets one to
+       itself, leaving the current chunk to fill up */
+    long size=(bytes>ARENA_CHUNK/4?bytes:ARENA_CHUNK);
+    char *chunk=_vorbis_malloc(&arena->allocator,ARENA_HEADER+size);
+    if(!chunk)return(NULL);
+    arena->size+=ARENA_HEADER+size;
+    if(size==bytes && arena->chunks){
+      *(void **)chunk=*(void **)arena->chunks;
+      *(void **)arena->chunks=chunk;
+      memset(chunk+ARENA_HEADER,0,bytes);
+      return(chunk+ARENA_HEADER);
+    }
+    *(void **)chunk=arena->chunks;
+    arena->chunks=chunk;
+    arena->top=chunk+ARENA_HEADER;
+    arena->left=size;
+  }
+  ret=arena->top;
+  arena->top+=bytes;
+  arena->left-=bytes;
+  memset(ret,0,bytes);
+  return(ret);
+}
+
+void _vorbis_arena_clear(vorbis_arena *arena){
+  void *chunk=arena->chunks;
+  while(chunk){
+    void *next=*(void **)chunk;
+    _vorbis_free(&arena->allocator,chunk);
+    chunk=next;
+  }
+  arena->chunks=NULL;
+  arena->top=NULL;
+  arena->left=0;
+  arena->size=0;
+}
+
 /* block abstraction setup *********************************************/
 
-#ifndef WORD_ALIGN
-#define WORD_ALIGN 8
-#endif
+/* the most one packet takes from the block: the channel vector
+   vorbis_synthesis() sets up plus what the largest mode's mapping
+   holds at once */
+static long _vorbis_block_bytes(vorbis_info *vi){
+  codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
+  long bytes=0;
+  int i;
+
+  for(i=0;i<ci->modes;i++){
+    int mapnum=ci->mode_param[i]->mapping;
+    long mode=_mapping_P[ci->map_type[mapnum]]->
+      inverse_bytes(vi,ci->mode_param[i],ci->map_param[mapnum]);
+    if(mode>bytes)bytes=mode;
+  }
+  return(ARENA_BYTES(vi->channels*sizeof(ogg_int32_t *))+bytes);
+}
 
+/* returns OV_EFAULT, with vb safe to clear, if the block storage
+   can't be allocated */
 int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   memset(vb,0,sizeof(*vb));
   vb->vd=v;
   vb->localalloc=0;
   vb->localstore=NULL;
+
+  /* block storage comes from the decoder's allocator, sized once for
+     the worst packet the setup allows so decoding doesn't allocate */
+  if(v->vi && v->vi->codec_setup){
+    codec_setup_info *ci=(codec_setup_info *)v->vi->codec_setup;
+    vb->allocator=ci->arena.allocator;
+    if(ci->modes>0){
+      long bytes=_vorbis_block_bytes(v->vi);
+      vb->localstore=_vorbis_malloc(&vb->allocator,bytes);
+      if(!vb->localstore)return(OV_EFAULT);
+      vb->localalloc=bytes;
+    }
+  }
   
   return(0);
 }
 
+/* returns NULL, leaving the block as it was, if more storage is
+   needed and can't be had */
 void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
   bytes=(bytes+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1);
   if(bytes+vb->localtop>vb->localalloc){
+    const vorbis_allocator *a=&vb->allocator;
+    /* highly conservative */
+    void *store=_vorbis_malloc(a,bytes);
+    if(!store)return(NULL);
+
     /* can't just _ogg_realloc... there are outstanding pointers */
     if(vb->localstore){
-      struct alloc_chain *link=(struct alloc_chain *)_ogg_malloc(sizeof(*link));
+      struct alloc_chain *link=(struct alloc_chain *)_vorbis_malloc(a,sizeof(*link));
+      if(!link){
+        _vorbis_free(a,store);
+        return(NULL);
+      }
       vb->totaluse+=vb->localtop;
       link->next=vb->reap;
       link->ptr=vb->localstore;
       vb->reap=link;
     }
-    /* highly conservative */
     vb->localalloc=bytes;
-    vb->localstore=_ogg_malloc(vb->localalloc);
+    vb->localstore=store;
     vb->localtop=0;
   }
   {
@@ -112,21 +238,34 @@ void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
   }
 }
 
+/* make sure the next 'bytes' handed out by _vorbis_block_alloc()
+   come from storage the block already holds, so that none of those
+   allocations can fail */
+int _vorbis_block_reserve(vorbis_block *vb,long bytes){
+  if(!_vorbis_block_alloc(vb,bytes))return(OV_EFAULT);
+  vb->localtop-=(bytes+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1);
+  return(0);
+}
+
 /* reap the chain, pull the ripcord */
 void _vorbis_block_ripcord(vorbis_block *vb){
   /* reap the chain */
   struct alloc_chain *reap=vb->reap;
+  const vorbis_allocator *a=&vb->allocator;
   while(reap){
     struct alloc_chain *next=reap->next;
-    _ogg_free(reap->ptr);
+    _vorbis_free(a,reap->ptr);
     memset(reap,0,sizeof(*reap));
-    _ogg_free(reap);
+    _vorbis_free(a,reap);
     reap=next;
   }
-  /* consolidate storage */
+  /* consolidate storage; nothing in it is live any more, so there's
+     nothing to copy */
   if(vb->totaluse){
-    vb->localstore=_ogg_realloc(vb->localstore,vb->totaluse+vb->localalloc);
+    _vorbis_free(a,vb->localstore);
     vb->localalloc+=vb->totaluse;
+    vb->localstore=_vorbis_malloc(a,vb->localalloc);
+    if(!vb->localstore)vb->localalloc=0;
     vb->totaluse=0;
   }
 
@@ -137,48 +276,212 @@ void _vorbis_block_ripcord(vorbis_block *vb){
 
 int vorbis_block_clear(vorbis_block *vb){
   _vorbis_block_ripcord(vb);
-  if(vb->localstore)_ogg_free(vb->localstore);
+  if(vb->localstore)_vorbis_free(&vb->allocator,vb->localstore);
 
   memset(vb,0,sizeof(*vb));
   return(0);
 }
 
-static int _vds_init(vorbis_dsp_state *v,vorbis_info *vi){
+/* the sizing pass: what _vds_init() takes from the setup's arena for
+   the decode codebooks, and from the dsp's for everything else.  Each
+   is computed from the setup header alone and must track what the
+   init functions allocate. */
+static long _vds_books_bytes(codec_setup_info *ci){
+  long bytes;
+  int i;
+
+  if(ci->fullbooks)return(ci->fullbooks_bytes);
+  bytes=ARENA_BYTES(ci->books*sizeof(*ci->fullbooks));
+  for(i=0;i<ci->books;i++)
+    if(ci->book_param[i])
+      bytes+=vorbis_book_decode_bytes(ci->book_param[i]);
+  return(bytes);
+}
+
+static long _vds_state_bytes(vorbis_info *vi){
+  codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
+  int hs=ci->halfrate_flag;
+  long storage=(ci->blocksizes[1]>>hs)/4+(ci->blocksizes[1]>>hs);
+  long bytes=ARENA_BYTES(sizeof(private_state));
   int i;
+
+  for(i=0;i<2;i++){
+    bytes+=ARENA_BYTES(sizeof(mdct_lookup));
+#ifndef _LOW_ACCURACY_
+    if(ci->lowaccuracy_flag)
+      bytes+=mdct_bytes_low(ci->blocksizes[i]>>hs);
+    else
+#endif
+      bytes+=mdct_bytes(ci->blocksizes[i]>>hs);
+  }
+
+  /* pcm, pcmret and the two sets of block buffers */
+  bytes+=4*ARENA_BYTES(vi->channels*sizeof(ogg_int32_t *));
+  bytes+=2*vi->channels*ARENA_BYTES(storage*sizeof(ogg_int32_t));
+
+  bytes+=ARENA_BYTES(ci->modes*sizeof(vorbis_look_mapping *));
+  for(i=0;i<ci->modes;i++){
+    int mapnum=ci->mode_param[i]->mapping;
+    bytes+=_mapping_P[ci->map_type[mapnum]]->
+      look_bytes(vi,ci->mode_param[i],ci->map_param[mapnum]);
+  }
+  return(bytes);
+}
+
+/* the memory vorbis_synthesis_init() will take for vi.  It's the
+   same for the life of vi, once the halfrate and accuracy modes are
+   set; the codebooks are counted even once they're built. */
+long vorbis_synthesis_memory(vorbis_info *vi){
+  codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
+  if(ci==NULL || ci->modes<=0)return(OV_EINVAL);
+  return(_vds_books_bytes(ci)+_vds_state_bytes(vi));
+}
+
+/* adds what each of vi, vc, v and vb holds to m; any may be NULL */
+void vorbis_memory_usage(vorbis_info *vi,vorbis_comment *vc,
+			 vorbis_dsp_state *v,vorbis_block *vb,
+			 vorbis_memory *m){
+  int i;
+
+  if(vi && vi->codec_setup){
+    codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
+    long books=(ci->fullbooks?ci->fullbooks_bytes:0);
+
+    /* the decode books share the setup's arena */
+    m->setup+=sizeof(*ci)+ci->arena.size-books;
+    m->codebooks+=books;
+    for(i=0;i<ci->books;i++)
+      if(ci->book_param[i])
+	m->codebooks+=vorbis_staticbook_bytes(ci->book_param[i]);
+  }
+
+  if(vc && vc->user_comments){
+    long per=sizeof(*vc->user_comments)+sizeof(*vc->comment_lengths);
+    if(vc->field_lengths)per+=sizeof(*vc->field_lengths);
+    if(vc->field_offsets)per+=sizeof(*vc->field_offsets);
+    m->comments+=(vc->comments+1)*per;
+    for(i=0;i<vc->comments;i++)
+      m->comments+=vc->comment_lengths[i]+1;
+    if(vc->vendor)m->comments+=strlen(vc->vendor)+1;
+  }
+
+  if(v && v->backend_state){
+    private_state *b=(private_state *)v->backend_state;
+    long pcm=4*ARENA_BYTES(v->vi->channels*sizeof(ogg_int32_t *))+
+      2*v->vi->channels*ARENA_BYTES(v->pcm_storage*sizeof(ogg_int32_t));
+
+    /* everything else in the dsp arena is lookups, transforms and
+       the private state */
+    m->pcm+=pcm;
+    m->lookups+=b->arena.size-pcm;
+  }
+
+  if(vb)
+    m->block+=vb->localalloc+vb->totaluse;
+}
+
+/* slab, if not NULL, holds the codebooks (in front, once built, for
+   the life of vi) and then the dsp state */
+static int _vds_init(vorbis_dsp_state *v,vorbis_info *vi,
+		     char *slab,long slabbytes){
+  int i,j,hs;
   codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
   private_state *b=NULL;
+  vorbis_arena *arena,state;
+  long books,statebytes;
 
   if(ci==NULL) return 1;
+  hs=ci->halfrate_flag;
 
   memset(v,0,sizeof(*v));
-  b=(private_state *)(v->backend_state=_ogg_calloc(1,sizeof(*b)));
 
-  v->vi=vi;
-  b->modebits=ilog(ci->modes);
+  /* size everything up front; the decode codebooks take one block of
+     the setup's arena, built once, and everything else one block of
+     the dsp's own.  Either can be the caller's slab. */
+  books=_vds_books_bytes(ci);
+  statebytes=_vds_state_bytes(vi);
+  if(slab && books+statebytes>slabbytes)return 1;
 
-  /* Vorbis I uses only window type 0 */
-  b->window[0]=_vorbis_window(0,ci->blocksizes[0]/2);
-  b->window[1]=_vorbis_window(0,ci->blocksizes[1]/2);
-
-  /* finish the codebooks */
+  /* finish the codebooks first, so each static book is gone before
+     the dsp state is taken */
   if(!ci->fullbooks){
-    ci->fullbooks=(codebook *)_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
+    if(slab)
+      _vorbis_arena_use(&ci->arena,slab,books);
+    else if(_vorbis_arena_reserve(&ci->arena,books))
+      return 1;
+    ci->fullbooks=(codebook *)_vorbis_arena_alloc(&ci->arena,
+					ci->books*sizeof(*ci->fullbooks));
     for(i=0;i<ci->books;i++){
       if(ci->book_param[i]==NULL)
         goto abort_books;
-      if(vorbis_book_init_decode(ci->fullbooks+i,ci->book_param[i]))
+      if(vorbis_book_init_decode(ci->fullbooks+i,ci->book_param[i],
+				 &ci->arena))
         goto abort_books;
       /* decode codebooks are now standalone after init */
-      vorbis_staticbook_destroy(ci->book_param[i]);
+      vorbis_staticbook_destroy(ci->book_param[i],&ci->arena.allocator);
       ci->book_param[i]=NULL;
     }
+    ci->fullbooks_bytes=books;
+  }
+
+  _vorbis_arena_init(&state,&ci->arena.allocator);
+  if(slab)
+    _vorbis_arena_use(&state,slab+books,statebytes);
+  else if(_vorbis_arena_reserve(&state,statebytes))
+    return 1;
+
+  /* everything below lives until vorbis_dsp_clear(), which frees it
+     all at once along with the arena, b included */
+  b=(private_state *)_vorbis_arena_alloc(&state,sizeof(*b));
+  b->arena=state;
+  arena=&b->arena;
+  v->backend_state=b;
+
+  v->vi=vi;
+  b->modebits=ilog(ci->modes);
+  b->blockbytes=_vorbis_block_bytes(vi);
+
+  /* Vorbis I uses only window type 0; windows and transform plans
+     for the two blocksizes come from the kernel set matching the
+     requested accuracy.  A _LOW_ACCURACY_ build has only the one. */
+#ifndef _LOW_ACCURACY_
+  if(ci->lowaccuracy_flag){
+    b->window[0]=_vorbis_window_low(0,(ci->blocksizes[0]>>hs)/2);
+    b->window[1]=_vorbis_window_low(0,(ci->blocksizes[1]>>hs)/2);
+    for(i=0;i<2;i++){
+      b->transform[i]=_vorbis_arena_alloc(arena,sizeof(mdct_lookup));
+      mdct_init_low((mdct_lookup *)b->transform[i],ci->blocksizes[i]>>hs,
+		    arena);
+    }
+    b->mdct_backward=mdct_backward_low;
+    b->apply_window=_vorbis_apply_window_low;
+  }else
+#endif
+  {
+    b->window[0]=_vorbis_window(0,(ci->blocksizes[0]>>hs)/2);
+    b->window[1]=_vorbis_window(0,(ci->blocksizes[1]>>hs)/2);
+    for(i=0;i<2;i++){
+      b->transform[i]=_vorbis_arena_alloc(arena,sizeof(mdct_lookup));
+      mdct_init((mdct_lookup *)b->transform[i],ci->blocksizes[i]>>hs,arena);
+    }
+    b->mdct_backward=mdct_backward;
+    b->apply_window=_vorbis_apply_window;
   }
 
-  v->pcm_storage=ci->blocksizes[1];
-  v->pcm=(ogg_int32_t **)_ogg_malloc(vi->channels*sizeof(*v->pcm));
-  v->pcmret=(ogg_int32_t **)_ogg_malloc(vi->channels*sizeof(*v->pcmret));
+  /* each block buffer leaves room ahead of the block for the part of
+     a long block's right half that a following short block does not
+     overlap; see vorbis_synthesis_blockin() */
+  b->pcmhead=(ci->blocksizes[1]>>hs)/4;
+  v->pcm_storage=b->pcmhead+(ci->blocksizes[1]>>hs);
+  v->pcm=(ogg_int32_t **)_vorbis_arena_alloc(arena,vi->channels*sizeof(*v->pcm));
+  v->pcmret=(ogg_int32_t **)_vorbis_arena_alloc(arena,vi->channels*sizeof(*v->pcmret));
+  for(j=0;j<2;j++){
+    b->pcmbuf[j]=(ogg_int32_t **)_vorbis_arena_alloc(arena,vi->channels*sizeof(**b->pcmbuf));
+    for(i=0;i<vi->channels;i++)
+      b->pcmbuf[j][i]=(ogg_int32_t *)_vorbis_arena_alloc(arena,v->pcm_storage*sizeof(***b->pcmbuf));
+  }
   for(i=0;i<vi->channels;i++)
-    v->pcm[i]=(ogg_int32_t *)_ogg_calloc(v->pcm_storage,sizeof(*v->pcm[i]));
+    v->pcm[i]=b->pcmbuf[0][i];
 
   /* all 1 (large block) or 0 (small block) */
   /* explicitly set for the sake of clarity */
@@ -186,7 +489,7 @@ static int _vds_init(vorbis_dsp_state *v,vorbis_info *vi){
   v->W=0;  /* current window size */
 
   /* initialize all the mapping/backend lookups */
-  b->mode=(vorbis_look_mapping **)_ogg_calloc(ci->modes,sizeof(*b->mode));
+  b->mode=(vorbis_look_mapping **)_vorbis_arena_alloc(arena,ci->modes*sizeof(*b->mode));
   for(i=0;i<ci->modes;i++){
     int mapnum=ci->mode_param[i]->mapping;
     int maptype=ci->map_type[mapnum];
@@ -197,7 +500,7 @@ static int _vds_init(vorbis_dsp_state *v,vorbis_info *vi){
 abort_books:
   for(i=0;i<ci->books;i++){
     if(ci->book_param[i]!=NULL){
-      vorbis_staticbook_destroy(ci->book_param[i]);
+      vorbis_staticbook_destroy(ci->book_param[i],&ci->arena.allocator);
       ci->book_param[i]=NULL;
     }
   }
@@ -214,50 +517,47 @@ int vorbis_synthesis_restart(vorbis_dsp_state *v){
   ci=vi->codec_setup;
   if(!ci)return -1;
 
-  v->centerW=ci->blocksizes[1]/2;
+  v->centerW=(ci->blocksizes[1]>>ci->halfrate_flag)/2;
   v->pcm_current=v->centerW;
   
   v->pcm_returned=-1;
   v->granulepos=-1;
   v->sequence=-1;
   ((private_state *)(v->backend_state))->sample_count=-1;
+  ((private_state *)(v->backend_state))->lapW=1;
 
   return(0);
 }
 
 int vorbis_synthesis_init(vorbis_dsp_state *v,vorbis_info *vi){
-  if(_vds_init(v,vi))return 1;
+  if(_vds_init(v,vi,NULL,0))return 1;
+  vorbis_synthesis_restart(v);
+
+  return 0;
+}
+
+/* as vorbis_synthesis_init, but carves the decoder from slab, which
+   must hold vorbis_synthesis_memory(vi) bytes, be aligned for any
+   type, and outlive vi.  The codebooks are built into its front the
+   first time, so every dsp state set up from vi must be given the
+   same slab, one at a time. */
+int vorbis_synthesis_init_slab(vorbis_dsp_state *v,vorbis_info *vi,
+			       void *slab,long bytes){
+  if(slab==NULL || _vds_init(v,vi,(char *)slab,bytes))return 1;
   vorbis_synthesis_restart(v);
 
   return 0;
 }
 
 void vorbis_dsp_clear(vorbis_dsp_state *v){
-  int i;
   if(v){
-    vorbis_info *vi=v->vi;
-    codec_setup_info *ci=(codec_setup_info *)(vi?vi->codec_setup:NULL);
     private_state *b=(private_state *)v->backend_state;
 
-    if(v->pcm){
-      for(i=0;i<vi->channels;i++)
-	if(v->pcm[i])_ogg_free(v->pcm[i]);
-      _ogg_free(v->pcm);
-      if(v->pcmret)_ogg_free(v->pcmret);
-    }
-
-    /* free mode lookups; these are actually vorbis_look_mapping structs */
-    if(ci){
-      for(i=0;i<ci->modes;i++){
-	int mapnum=ci->mode_param[i]->mapping;
-	int maptype=ci->map_type[mapnum];
-	if(b && b->mode)_mapping_P[maptype]->free_look(b->mode[i]);
-      }
-    }
-
+    /* the lookups, transforms and buffers are all in the arena, as
+       is b itself */
     if(b){
-      if(b->mode)_ogg_free(b->mode);    
-      _ogg_free(b);
+      vorbis_arena arena=b->arena;
+      _vorbis_arena_clear(&arena);
     }
     
     memset(v,0,sizeof(*v));
@@ -266,12 +566,15 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
 
 /* Unlike in analysis, the window is only partially applied for each
    block.  The time domain envelope is not yet handled at the point of
-   calling (as it relies on the previous block). */
+   calling (as it relies on the previous block).  vb must be the block
+   most recently decoded by vorbis_synthesis() with v; its pcm is
+   already in v's free block buffer and is lapped there in place. */
 
 int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
   vorbis_info *vi=v->vi;
   codec_setup_info *ci=(codec_setup_info *)vi->codec_setup;
   private_state *b=v->backend_state;
+  int hs=ci->halfrate_flag;
   int i,j;
 
   if(v->pcm_current>v->pcm_returned  && v->pcm_returned!=-1)return(OV_EINVAL);
@@ -290,87 +593,99 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
   
   if(vb->pcm){  /* no pcm to process if vorbis_synthesis_trackonly 
                    was called on block */
-    int n=ci->blocksizes[v->W]/2;
-    int n0=ci->blocksizes[0]/2;
-    int n1=ci->blocksizes[1]/2;
-    
-    int thisCenter;
-    int prevCenter;
+    int n0=(ci->blocksizes[0]>>hs)/2;
+    int n1=(ci->blocksizes[1]>>hs)/2;
     
-    if(v->centerW){
-      thisCenter=n1;
-      prevCenter=0;
-    }else{
-      thisCenter=0;
-      prevCenter=n1;
+    /* The block was decoded straight into the free one of the two
+       buffers in the backend state (see vorbis_synthesis); the other
+       still holds the previous block.  Lap the previous block's right
+       half into this block's left half in place and return the
+       finished samples from this buffer; this block's right half then
+       simply stays put as the overlap for the next one, and the
+       previous buffer is free to take the next block.
+
+       Samples where the window is zero were never written (see
+       _vorbis_apply_window), so only each block's nonzero extent may
+       be read.  That extent follows the block's own lW/nW flags; if
+       they disagree with the neighbouring blocks actually decoded
+       (a lost or corrupt packet) the large/large lap below shrinks to
+       match. */
+    int cur=!b->pcmcur;
+    long head=b->pcmhead;
+    long start=head;
+    long lapbegin=(vb->lW?0:n1/2-n0/2);
+    long lapend=(b->lapW?n1:n1/2+n0/2);
+
+    if(v->lW!=v->W){
+      /* large/small: the finished span begins in the part of the
+	 previous block that nothing overlaps; it moves into the
+	 headroom ahead of this block.  small/large: it begins where
+	 the short window starts. */
+      if(v->lW)
+	start-=n1/2-n0/2;
+      else
+	start+=n1/2-n0/2;
     }
-    
-    /* v->pcm is now used like a two-stage double buffer.  We don't want
-       to have to constantly shift *or* adjust memory usage.  Don't
-       accept a new block until the old is shifted out */
-    
-    /* overlap/add PCM */
+
+    /* overlap/add PCM; the first block after a restart returns
+       nothing, so only its right half (left in place) matters */
     
     for(j=0;j<vi->channels;j++){
-      /* the overlap/add section */
-      if(v->lW){
+      ogg_int32_t *pcm=b->pcmbuf[cur][j]+head;
+      ogg_int32_t *p=b->pcmbuf[!cur][j]+head;
+
+      if(v->pcm_returned==-1){
+	/* nothing to lap */
+      }else if(v->lW){
 	if(v->W){
 	  /* large/large */
-	  ogg_int32_t *pcm=v->pcm[j]+prevCenter;
-	  ogg_int32_t *p=vb->pcm[j];
-	  for(i=0;i<n1;i++)
+	  p+=n1;
+	  for(i=0;i<lapbegin;i++)
+	    pcm[i]=p[i];
+	  for(;i<lapend;i++)
 	    pcm[i]+=p[i];
 	}else{
 	  /* large/small */
-	  ogg_int32_t *pcm=v->pcm[j]+prevCenter+n1/2-n0/2;
-	  ogg_int32_t *p=vb->pcm[j];
-	  for(i=0;i<n0;i++)
+	  p+=n1;
+	  pcm-=n1/2-n0/2;
+	  for(i=0;i<n1/2-n0/2;i++)
+	    pcm[i]=p[i];
+	  for(;i<n1/2+n0/2;i++)
 	    pcm[i]+=p[i];
 	}
       }else{
 	if(v->W){
 	  /* small/large */
-	  ogg_int32_t *pcm=v->pcm[j]+prevCenter;
-	  ogg_int32_t *p=vb->pcm[j]+n1/2-n0/2;
+	  p+=n0;
+	  pcm+=n1/2-n0/2;
 	  for(i=0;i<n0;i++)
 	    pcm[i]+=p[i];
-	  for(;i<n1/2+n0/2;i++)
-	    pcm[i]=p[i];
 	}else{
 	  /* small/small */
-	  ogg_int32_t *pcm=v->pcm[j]+prevCenter;
-	  ogg_int32_t *p=vb->pcm[j];
+	  p+=n0;
 	  for(i=0;i<n0;i++)
 	    pcm[i]+=p[i];
 	}
       }
-      
-      /* the copy section */
-      {
-	ogg_int32_t *pcm=v->pcm[j]+thisCenter;
-	ogg_int32_t *p=vb->pcm[j]+n;
-	for(i=0;i<n;i++)
-	  pcm[i]=p[i];
-      }
+
+      v->pcm[j]=b->pcmbuf[cur][j];
     }
     
-    if(v->centerW)
-      v->centerW=0;
-    else
-      v->centerW=n1;
+    b->pcmcur=cur;
+    b->lapW=vb->nW;
     
     /* deal with initial packet state; we do this using the explicit
        pcm_returned==-1 flag otherwise we're sensitive to first block
        being short or long */
 
     if(v->pcm_returned==-1){
-      v->pcm_returned=thisCenter;
-      v->pcm_current=thisCenter;
+      v->pcm_returned=start;
+      v->pcm_current=start;
     }else{
-      v->pcm_returned=prevCenter;
-      v->pcm_current=prevCenter+
-	ci->blocksizes[v->lW]/4+
-	ci->blocksizes[v->W]/4;
+      v->pcm_returned=start;
+      v->pcm_current=start+
+	((ci->blocksizes[v->lW]/4+
+	  ci->blocksizes[v->W]/4)>>hs);
     }
 
   }
@@ -420,13 +735,13 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
           /* Guard against corrupt/malicious frames that set EOP and
              a backdated granpos; don't rewind more samples than we
              actually have */
-          if(extra > v->pcm_current - v->pcm_returned)
-            extra = v->pcm_current - v->pcm_returned;
+          if(extra > (v->pcm_current - v->pcm_returned)<<hs)
+            extra = (v->pcm_current - v->pcm_returned)<<hs;
 
-	  v->pcm_current-=extra;
+	  v->pcm_current-=extra>>hs;
 	}else{
 	  /* trim the beginning */
-	  v->pcm_returned+=extra;
+	  v->pcm_returned+=extra>>hs;
 	  if(v->pcm_returned>v->pcm_current)
 	    v->pcm_returned=v->pcm_current;
 	}
@@ -448,8 +763,8 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
             /* Guard against corrupt/malicious frames that set EOP and
                a backdated granpos; don't rewind more samples than we
                actually have */
-            if(extra > v->pcm_current - v->pcm_returned)
-              extra = v->pcm_current - v->pcm_returned;
+            if(extra > (v->pcm_current - v->pcm_returned)<<hs)
+              extra = (v->pcm_current - v->pcm_returned)<<hs;
 
             /* we use ogg_int64_t for granule positions because a
                uint64 isn't universally available.  Unfortunately,
@@ -458,7 +773,7 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
             if(extra<0)
               extra=0;
 
-            v->pcm_current-=extra;
+            v->pcm_current-=extra>>hs;
 
 	  } /* else {Shouldn't happen *unless* the bitstream is out of
 	       spec.  Either way, believe the bitstream } */
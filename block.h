@@ -20,5 +20,6 @@
 
 extern void _vorbis_block_ripcord(vorbis_block *vb);
 extern void *_vorbis_block_alloc(vorbis_block *vb,long bytes);
+extern int _vorbis_block_reserve(vorbis_block *vb,long bytes);
 
 #endif
@@ -24,9 +24,12 @@
 
 /* unpacks a codebook from the packet buffer into the codebook struct,
    readies the codebook auxiliary structures for decode *************/
-static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb){
+static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb,
+					  const vorbis_allocator *a){
   long i,j;
-  static_codebook *s=_ogg_calloc(1,sizeof(*s));
+  static_codebook *s=_vorbis_malloc(a,sizeof(*s));
+  if(!s)return(NULL);
+  memset(s,0,sizeof(*s));
 
   /* make sure alignment is correct */
   if(oggpack_read(opb,24)!=0x564342)goto _eofout;
@@ -47,7 +50,8 @@ static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb){
     if((s->entries*(unused?1:5)+7)>>3>opb->storage-oggpack_bytes(opb))
       goto _eofout;
     /* unordered */
-    s->lengthlist=(long *)_ogg_malloc(sizeof(*s->lengthlist)*s->entries);
+    s->lengthlist=(long *)_vorbis_malloc(a,sizeof(*s->lengthlist)*s->entries);
+    if(!s->lengthlist)goto _errout;
 
     /* allocated but unused entries? */
     if(unused){
@@ -77,7 +81,8 @@ static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb){
     {
       long length=oggpack_read(opb,5)+1;
       if(length==0)goto _eofout;
-      s->lengthlist=(long *)_ogg_malloc(sizeof(*s->lengthlist)*s->entries);
+      s->lengthlist=(long *)_vorbis_malloc(a,sizeof(*s->lengthlist)*s->entries);
+      if(!s->lengthlist)goto _errout;
 
       for(i=0;i<s->entries;){
 	long num=oggpack_read(opb,_ilog(s->entries-i));
@@ -126,7 +131,8 @@ static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb){
       /* quantized values */
       if((quantvals*s->q_quant+7)>>3>opb->storage-oggpack_bytes(opb))
         goto _eofout;
-      s->quantlist=(long *)_ogg_malloc(sizeof(*s->quantlist)*quantvals);
+      s->quantlist=(long *)_vorbis_malloc(a,sizeof(*s->quantlist)*quantvals);
+      if(!s->quantlist)goto _errout;
       for(i=0;i<quantvals;i++)
 	s->quantlist[i]=oggpack_read(opb,s->q_quant);
       
@@ -142,7 +148,7 @@ static_codebook *vorbis_staticbook_unpack(oggpack_buffer *opb){
   
  _errout:
  _eofout:
-  vorbis_staticbook_destroy(s);
+  vorbis_staticbook_destroy(s,a);
   return(NULL); 
 }
 
@@ -242,28 +248,29 @@ long vorbis_book_decode(codebook *book, oggpack_buffer *b){
 /* returns 0 on OK or -1 on eof *************************************/
 /* decode vector / dim granularity gaurding is done in the upper layer */
 long vorbis_book_decodevs_add(codebook *book,ogg_int32_t *a,
-			      oggpack_buffer *b,int n,int point){
+			      oggpack_buffer *b,int n,int point,
+			      ogg_int32_t **work){
   if(book->used_entries>0){  
     const int step=n/book->dim;
-    VAR_STACK(long, entry, step);
-    VAR_STACK(ogg_int32_t *, t, step);
+    ogg_int32_t **t=work;
+    long entry;
     int i,j,o;
     int shift=point-book->binarypoint;
     
     if(shift>=0){
       for (i = 0; i < step; i++) {
-	entry[i]=decode_packed_entry_number(book,b);
-	if(entry[i]==-1)return(-1);
-	t[i] = book->valuelist+entry[i]*book->dim;
+	entry=decode_packed_entry_number(book,b);
+	if(entry==-1)return(-1);
+	t[i] = book->valuelist+entry*book->dim;
       }
       for(i=0,o=0;i<book->dim;i++,o+=step)
 	for (j=0;o+j<n && j<step;j++)
 	  a[o+j]+=t[j][i]>>shift;
     }else{
       for (i = 0; i < step; i++) {
-	entry[i]=decode_packed_entry_number(book,b);
-	if(entry[i]==-1)return(-1);
-	t[i] = book->valuelist+entry[i]*book->dim;
+	entry=decode_packed_entry_number(book,b);
+	if(entry==-1)return(-1);
+	t[i] = book->valuelist+entry*book->dim;
       }
       for(i=0,o=0;i<book->dim;i++,o+=step)
 	for (j=0;o+j<n && j<step;j++)
@@ -275,7 +282,8 @@ long vorbis_book_decodevs_add(codebook *book,ogg_int32_t *a,
 
 /* decode vector / dim granularity gaurding is done in the upper layer */
 long vorbis_book_decodev_add(codebook *book,ogg_int32_t *a,
-			     oggpack_buffer *b,int n,int point){
+			     oggpack_buffer *b,int n,int point,
+			     ogg_int32_t **work){
   if(book->used_entries>0){
     int i,j,entry;
     ogg_int32_t *t;
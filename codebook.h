@@ -76,21 +76,31 @@ typedef struct codebook{
 
 } codebook;
 
-extern void vorbis_staticbook_destroy(static_codebook *b);
-extern int vorbis_book_init_decode(codebook *dest,const static_codebook *source);
+struct vorbis_arena; /* misc.h */
+
+extern void vorbis_staticbook_destroy(static_codebook *b,
+				      const vorbis_allocator *a);
+extern int vorbis_book_init_decode(codebook *dest,const static_codebook *source,
+				   struct vorbis_arena *arena);
+extern long vorbis_book_decode_bytes(const static_codebook *source);
+extern long vorbis_staticbook_bytes(const static_codebook *b);
 
-extern void vorbis_book_clear(codebook *b);
 extern long _book_maptype1_quantvals(const static_codebook *b);
 
-extern static_codebook *vorbis_staticbook_unpack(oggpack_buffer *b);
+extern static_codebook *vorbis_staticbook_unpack(oggpack_buffer *b,
+						 const vorbis_allocator *a);
 
 extern long vorbis_book_decode(codebook *book, oggpack_buffer *b);
+/* work holds n/dim pointers for decodevs_add; decodev_add takes it
+   only so the two can be called through the same pointer */
 extern long vorbis_book_decodevs_add(codebook *book, ogg_int32_t *a, 
-				     oggpack_buffer *b,int n,int point);
+				     oggpack_buffer *b,int n,int point,
+				     ogg_int32_t **work);
 extern long vorbis_book_decodev_set(codebook *book, ogg_int32_t *a, 
 				    oggpack_buffer *b,int n,int point);
 extern long vorbis_book_decodev_add(codebook *book, ogg_int32_t *a, 
-				    oggpack_buffer *b,int n,int point);
+				    oggpack_buffer *b,int n,int point,
+				    ogg_int32_t **work);
 extern long vorbis_book_decodevv_add(codebook *book, ogg_int32_t **a,
 				     long off,int ch, 
 				    oggpack_buffer *b,int n,int point);
@@ -19,6 +19,7 @@
 #define _V_CODECI_H_
 
 #include "codebook.h"
+#include "mdct.h"
 
 typedef void vorbis_look_mapping;
 typedef void vorbis_look_floor;
@@ -40,13 +41,32 @@ typedef void vorbis_info_mapping;
 typedef struct private_state {
   /* local lookup storage */
   const void             *window[2];
+  vorbis_look_transform  *transform[2];
+
+  /* per-block kernels, of the accuracy chosen at setup */
+  void                  (*mdct_backward)(mdct_lookup *,ogg_int32_t *,
+					 ogg_int32_t *);
+  void                  (*apply_window)(ogg_int32_t *,const void *[2],
+					long *,int,int,int);
+
+  /* block pcm is decoded straight into one of these; they trade
+     roles every block, see vorbis_synthesis_blockin() */
+  ogg_int32_t           **pcmbuf[2];
+  int                     pcmcur;   /* buffer holding the last block */
+  long                    pcmhead;  /* room ahead of the block data */
+  int                     lapW;     /* window the last block's right
+					     half was cut to (its nW) */
 
   /* backend lookups are tied to the mode, not the backend or naked mapping */
   int                     modebits;
   vorbis_look_mapping   **mode;
+  long                    blockbytes; /* the most a packet takes from
+					 its vorbis_block */
 
   ogg_int64_t sample_count;
 
+  vorbis_arena            arena;    /* the lookups and buffers above */
+
 } private_state;
 
 /* codec_setup_info contains all the setup information specific to the
@@ -84,9 +104,19 @@ typedef struct codec_setup_info {
   vorbis_info_residue    *residue_param[64];
   static_codebook        *book_param[256];
   codebook               *fullbooks;
+  long                    fullbooks_bytes; /* once built */
 
   int    passlimit[32];     /* iteration limit per couple/quant pass */
   int    coupling_passes;
+
+  int    halfrate_flag;     /* painless downsample for decode */
+  int    preview_stages;    /* residue cascade passes to apply; 0 = all */
+  int    lowaccuracy_flag;  /* 32 bit multiplies and 8 bit tables */
+
+  /* the backend setup and decode codebooks; the static codebooks are
+     only held until the decode books are built, and come straight
+     from the arena's allocator */
+  vorbis_arena arena;
 } codec_setup_info;
 
 #endif
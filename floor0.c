@@ -132,6 +132,7 @@ static const unsigned char MLOOP_2[64]={
 
 static const unsigned char MLOOP_3[8]={0,1,2,2,3,3,3,3};
 
+/* lsp is converted to cosines in place, so it's gone afterward */
 void vorbis_lsp_to_curve(ogg_int32_t *curve,int *map,int n,int ln,
 			 ogg_int32_t *lsp,int m,
 			 ogg_int32_t amp,
@@ -144,7 +145,7 @@ void vorbis_lsp_to_curve(ogg_int32_t *curve,int *map,int n,int ln,
   int i;
   int ampoffseti=ampoffset*4096;
   int ampi=amp;
-  VAR_STACK(ogg_int32_t, ilsp, m);
+  ogg_int32_t *ilsp=lsp;
   /* lsp is in 8.24, range 0 to PI; coslook wants it in .16 0 to 1*/
   for(i=0;i<m;i++){
 #ifndef _LOW_ACCURACY_
@@ -287,30 +288,13 @@ void vorbis_lsp_to_curve(ogg_int32_t *curve,int *map,int n,int ln,
 
 /*************** vorbis decode glue ************/
 
-static void floor0_free_info(vorbis_info_floor *i){
-  vorbis_info_floor0 *info=(vorbis_info_floor0 *)i;
-  if(info){
-    memset(info,0,sizeof(*info));
-    _ogg_free(info);
-  }
-}
-
-static void floor0_free_look(vorbis_look_floor *i){
-  vorbis_look_floor0 *look=(vorbis_look_floor0 *)i;
-  if(look){
-
-    if(look->linearmap)_ogg_free(look->linearmap);
-    if(look->lsp_look)_ogg_free(look->lsp_look);
-    memset(look,0,sizeof(*look));
-    _ogg_free(look);
-  }
-}
-
 static vorbis_info_floor *floor0_unpack (vorbis_info *vi,oggpack_buffer *opb){
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
   int j;
 
-  vorbis_info_floor0 *info=(vorbis_info_floor0 *)_ogg_malloc(sizeof(*info));
+  vorbis_info_floor0 *info=(vorbis_info_floor0 *)
+    _vorbis_arena_alloc(&ci->arena,sizeof(*info));
+  if(!info)goto err_out;
   info->order=oggpack_read(opb,8);
   info->rate=oggpack_read(opb,16);
   info->barkmap=oggpack_read(opb,16);
@@ -332,7 +316,6 @@ static vorbis_info_floor *floor0_unpack (vorbis_info *vi,oggpack_buffer *opb){
   return(info);
 
  err_out:
-  floor0_free_info(info);
   return(NULL);
 }
 
@@ -350,7 +333,9 @@ static vorbis_look_floor *floor0_look (vorbis_dsp_state *vd,vorbis_info_mode *mi
   vorbis_info        *vi=vd->vi;
   codec_setup_info   *ci=(codec_setup_info *)vi->codec_setup;
   vorbis_info_floor0 *info=(vorbis_info_floor0 *)i;
-  vorbis_look_floor0 *look=(vorbis_look_floor0 *)_ogg_calloc(1,sizeof(*look));
+  vorbis_arena       *arena=&((private_state *)vd->backend_state)->arena;
+  vorbis_look_floor0 *look=(vorbis_look_floor0 *)
+    _vorbis_arena_alloc(arena,sizeof(*look));
   look->m=info->order;
   look->n=ci->blocksizes[mi->blockflag]/2;
   look->ln=info->barkmap;
@@ -362,7 +347,7 @@ static vorbis_look_floor *floor0_look (vorbis_dsp_state *vd,vorbis_info_mode *mi
      the encoder may do what it wishes in filling them.  They're
      necessary in some mapping combinations to keep the scale spacing
      accurate */
-  look->linearmap=(int *)_ogg_malloc((look->n+1)*sizeof(*look->linearmap));
+  look->linearmap=(int *)_vorbis_arena_alloc(arena,(look->n+1)*sizeof(*look->linearmap));
   for(j=0;j<look->n;j++){
 
     int val=(look->ln*
@@ -373,13 +358,25 @@ static vorbis_look_floor *floor0_look (vorbis_dsp_state *vd,vorbis_info_mode *mi
   }
   look->linearmap[j]=-1;
 
-  look->lsp_look=(ogg_int32_t *)_ogg_malloc(look->ln*sizeof(*look->lsp_look));
+  look->lsp_look=(ogg_int32_t *)_vorbis_arena_alloc(arena,look->ln*sizeof(*look->lsp_look));
   for(j=0;j<look->ln;j++)
     look->lsp_look[j]=vorbis_coslook2_i(0x10000*j/look->ln);
 
   return look;
 }
 
+/* what floor0_look() takes from the dsp arena */
+static long floor0_look_bytes(vorbis_info *vi,vorbis_info_mode *mi,
+			      vorbis_info_floor *i){
+  codec_setup_info   *ci=(codec_setup_info *)vi->codec_setup;
+  vorbis_info_floor0 *info=(vorbis_info_floor0 *)i;
+  long n=ci->blocksizes[mi->blockflag]/2;
+
+  return(ARENA_BYTES(sizeof(vorbis_look_floor0))+
+	 ARENA_BYTES((n+1)*sizeof(int))+
+	 ARENA_BYTES(info->barkmap*sizeof(ogg_int32_t)));
+}
+
 static void *floor0_inverse1(vorbis_block *vb,vorbis_look_floor *i){
   vorbis_look_floor0 *look=(vorbis_look_floor0 *)i;
   vorbis_info_floor0 *info=look->vi;
@@ -411,6 +408,12 @@ static void *floor0_inverse1(vorbis_block *vb,vorbis_look_floor *i){
   return(NULL);
 }
 
+/* what floor0_inverse1() takes from the block for one channel */
+static long floor0_inverse_bytes(vorbis_info *vi,vorbis_info_floor *i){
+  vorbis_info_floor0 *info=(vorbis_info_floor0 *)i;
+  return(ARENA_BYTES((info->order+1)*sizeof(ogg_int32_t)));
+}
+
 static int floor0_inverse2(vorbis_block *vb,vorbis_look_floor *i,
 			   void *memo,ogg_int32_t *out){
   vorbis_look_floor0 *look=(vorbis_look_floor0 *)i;
@@ -431,7 +434,7 @@ static int floor0_inverse2(vorbis_block *vb,vorbis_look_floor *i,
 
 /* export hooks */
 vorbis_func_floor floor0_exportbundle={
-  &floor0_unpack,&floor0_look,&floor0_free_info,
-  &floor0_free_look,&floor0_inverse1,&floor0_inverse2
+  &floor0_unpack,&floor0_look,&floor0_look_bytes,&floor0_inverse1,
+  &floor0_inverse2,&floor0_inverse_bytes
 };
 
@@ -0,0 +1,25 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis 'TREMOR' CODEC SOURCE CODE.   *
+ *                                                                  *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis 'TREMOR' SOURCE CODE IS (C) COPYRIGHT 1994-2002    *
+ * BY THE Xiph.Org FOUNDATION http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: low accuracy floor backend 0
+
+ ********************************************************************/
+
+/* floor0.c with _LOW_ACCURACY_; see mdct_low.c */
+
+#ifndef _LOW_ACCURACY_
+#define _LOW_ACCURACY_
+#define vorbis_lsp_to_curve vorbis_lsp_to_curve_low
+#define floor0_exportbundle floor0_exportbundle_low
+#include "floor0.c"
+#endif
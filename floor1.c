@@ -42,22 +42,6 @@ typedef struct {
 
 /***********************************************/
  
-static void floor1_free_info(vorbis_info_floor *i){
-  vorbis_info_floor1 *info=(vorbis_info_floor1 *)i;
-  if(info){
-    memset(info,0,sizeof(*info));
-    _ogg_free(info);
-  }
-}
-
-static void floor1_free_look(vorbis_look_floor *i){
-  vorbis_look_floor1 *look=(vorbis_look_floor1 *)i;
-  if(look){
-    memset(look,0,sizeof(*look));
-    _ogg_free(look);
-  }
-}
-
 static int ilog(unsigned int v){
   int ret=0;
   while(v){
@@ -75,7 +59,9 @@ static vorbis_info_floor *floor1_unpack (vorbis_info *vi,oggpack_buffer *opb){
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
   int j,k,count=0,maxclass=-1,rangebits;
 
-  vorbis_info_floor1 *info=(vorbis_info_floor1 *)_ogg_calloc(1,sizeof(*info));
+  vorbis_info_floor1 *info=(vorbis_info_floor1 *)
+    _vorbis_arena_alloc(&ci->arena,sizeof(*info));
+  if(!info)goto err_out;
   /* read partitions */
   info->partitions=oggpack_read(opb,5); /* only 0 to 31 legal */
   for(j=0;j<info->partitions;j++){
@@ -131,7 +117,6 @@ static vorbis_info_floor *floor1_unpack (vorbis_info *vi,oggpack_buffer *opb){
   return(info);
   
  err_out:
-  floor1_free_info(info);
   return(NULL);
 }
 
@@ -140,7 +125,9 @@ static vorbis_look_floor *floor1_look(vorbis_dsp_state *vd,vorbis_info_mode *mi,
 
   int *sortpointer[VIF_POSIT+2];
   vorbis_info_floor1 *info=(vorbis_info_floor1 *)in;
-  vorbis_look_floor1 *look=(vorbis_look_floor1 *)_ogg_calloc(1,sizeof(*look));
+  vorbis_look_floor1 *look=(vorbis_look_floor1 *)
+    _vorbis_arena_alloc(&((private_state *)vd->backend_state)->arena,
+			sizeof(*look));
   int i,j,n=0;
 
   look->vi=info;
@@ -206,6 +193,12 @@ static vorbis_look_floor *floor1_look(vorbis_dsp_state *vd,vorbis_info_mode *mi,
   return(look);
 }
 
+/* what floor1_look() takes from the dsp arena */
+static long floor1_look_bytes(vorbis_info *vi,vorbis_info_mode *mi,
+			      vorbis_info_floor *in){
+  return(ARENA_BYTES(sizeof(vorbis_look_floor1)));
+}
+
 static int render_point(int x0,int x1,int y0,int y1,int x){
   y0&=0x7fff; /* mask off flag */
   y1&=0x7fff;
@@ -410,6 +403,15 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
   return(NULL);
 }
 
+/* what floor1_inverse1() takes from the block for one channel */
+static long floor1_inverse_bytes(vorbis_info *vi,vorbis_info_floor *in){
+  vorbis_info_floor1 *info=(vorbis_info_floor1 *)in;
+  int i,posts=2;
+
+  for(i=0;i<info->partitions;i++)posts+=info->class_dim[info->partitionclass[i]];
+  return(ARENA_BYTES(posts*sizeof(int)));
+}
+
 static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 			  ogg_int32_t *out){
   vorbis_look_floor1 *look=(vorbis_look_floor1 *)in;
@@ -453,7 +455,7 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 
 /* export hooks */
 vorbis_func_floor floor1_exportbundle={
-  &floor1_unpack,&floor1_look,&floor1_free_info,
-  &floor1_free_look,&floor1_inverse1,&floor1_inverse2
+  &floor1_unpack,&floor1_look,&floor1_look_bytes,&floor1_inverse1,
+  &floor1_inverse2,&floor1_inverse_bytes
 };
 
@@ -96,16 +96,52 @@ void vorbis_comment_clear(vorbis_comment *vc){
   if(vc){
     long i;
     if(vc->user_comments){
-      for(i=0;i<vc->comments;i++)
-        if(vc->user_comments[i])_ogg_free(vc->user_comments[i]);
+      if(!vc->storage)
+        for(i=0;i<vc->comments;i++)
+          if(vc->user_comments[i])_ogg_free(vc->user_comments[i]);
       _ogg_free(vc->user_comments);
     }
     if(vc->comment_lengths)_ogg_free(vc->comment_lengths);
-    if(vc->vendor)_ogg_free(vc->vendor);
+    if(vc->vendor && !vc->storage)_ogg_free(vc->vendor);
+    if(vc->field_lengths)_ogg_free(vc->field_lengths);
+    if(vc->field_offsets)_ogg_free(vc->field_offsets);
+    if(vc->storage)_ogg_free(vc->storage);
     memset(vc,0,sizeof(*vc));
   }
 }
 
+/* copy comment field i, as it was in the comment header packet op,
+   into buffer.  This is how a field left out by max_length or the
+   filter is read; op must be the packet the comments came from.
+   Returns the length of the field, copying nothing if buffer is
+   NULL. */
+int vorbis_comment_fetch(vorbis_comment *vc,ogg_packet *op,int i,
+			 char *buffer,int bytes){
+  const unsigned char *p;
+  long offset;
+  int len;
+
+  if(!vc->field_lengths || i<0 || i>=vc->comments)return(OV_EINVAL);
+  len=vc->field_lengths[i];
+  if(!buffer)return(len);
+  if(bytes<len)return(OV_EINVAL);
+
+  if(vc->comment_lengths[i]==len){
+    memcpy(buffer,vc->user_comments[i],len);
+    return(len);
+  }
+
+  /* the field is preceded by its length; check the packet matches */
+  offset=vc->field_offsets[i];
+  if(!op || offset<4 || offset+len>op->bytes)return(OV_EINVAL);
+  p=op->packet+offset-4;
+  if(p[0]+(p[1]<<8)+(p[2]<<16)+((ogg_uint32_t)p[3]<<24)!=(ogg_uint32_t)len)
+    return(OV_EINVAL);
+
+  memcpy(buffer,op->packet+offset,len);
+  return(len);
+}
+
 /* blocksize 0 is guaranteed to be short, 1 is guarantted to be long.
    They may be equal, but short will never ge greater than long */
 int vorbis_info_blocksize(vorbis_info *vi,int zo){
@@ -115,8 +151,20 @@ int vorbis_info_blocksize(vorbis_info *vi,int zo){
 
 /* used by synthesis, which has a full, alloced vi */
 void vorbis_info_init(vorbis_info *vi){
+  vorbis_info_init_alloc(vi,NULL);
+}
+
+/* as vorbis_info_init, but the setup, and any decoder set up from it,
+   takes its memory from allocator */
+void vorbis_info_init_alloc(vorbis_info *vi,const vorbis_allocator *allocator){
+  codec_setup_info *ci;
   memset(vi,0,sizeof(*vi));
-  vi->codec_setup=(codec_setup_info *)_ogg_calloc(1,sizeof(codec_setup_info));
+  ci=(codec_setup_info *)_vorbis_malloc(allocator,sizeof(*ci));
+  if(ci){
+    memset(ci,0,sizeof(*ci));
+    _vorbis_arena_init(&ci->arena,allocator);
+  }
+  vi->codec_setup=ci;
 }
 
 void vorbis_info_clear(vorbis_info *vi){
@@ -124,34 +172,18 @@ void vorbis_info_clear(vorbis_info *vi){
   int i;
 
   if(ci){
-
-    for(i=0;i<ci->modes;i++)
-      if(ci->mode_param[i])_ogg_free(ci->mode_param[i]);
-
-    for(i=0;i<ci->maps;i++) /* unpack does the range checking */
-      if(ci->map_param[i])
-	_mapping_P[ci->map_type[i]]->free_info(ci->map_param[i]);
-
-    for(i=0;i<ci->floors;i++) /* unpack does the range checking */
-      if(ci->floor_param[i])
-	_floor_P[ci->floor_type[i]]->free_info(ci->floor_param[i]);
-    
-    for(i=0;i<ci->residues;i++) /* unpack does the range checking */
-      if(ci->residue_param[i])
-	_residue_P[ci->residue_type[i]]->free_info(ci->residue_param[i]);
+    vorbis_allocator allocator=ci->arena.allocator;
 
     for(i=0;i<ci->books;i++){
       if(ci->book_param[i]){
 	/* knows if the book was not alloced */
-	vorbis_staticbook_destroy(ci->book_param[i]);
+	vorbis_staticbook_destroy(ci->book_param[i],&allocator);
       }
-      if(ci->fullbooks)
-	vorbis_book_clear(ci->fullbooks+i);
     }
-    if(ci->fullbooks)
-	_ogg_free(ci->fullbooks);
-    
-    _ogg_free(ci);
+
+    /* the backend setup and decode codebooks go with the arena */
+    _vorbis_arena_clear(&ci->arena);
+    _vorbis_free(&allocator,ci);
   }
 
   memset(vi,0,sizeof(*vi));
@@ -190,35 +222,90 @@ static int _vorbis_unpack_info(vorbis_info *vi,oggpack_buffer *opb){
   return(OV_EBADHEADER);
 }
 
-static int _vorbis_unpack_comment(vorbis_comment *vc,oggpack_buffer *opb){
+/* a field is copied out of the packet unless it's longer than
+   max_length or the filter turns it down.  Of a field that isn't,
+   only its "TAG=" is kept. */
+static int _vorbis_comment_keep(vorbis_comment *vc,const unsigned char *field,
+				int len){
+  int taglen=0;
+
+  if(vc->max_length>0 && len>vc->max_length)return(0);
+  if(vc->filter){
+    while(taglen<len && field[taglen]!='=')taglen++;
+    if(vc->filter(vc->filter_data,(const char *)field,taglen,len))return(0);
+  }
+  return(1);
+}
+
+static void _v_skipbytes(oggpack_buffer *o,long bytes){
+  /* oggpack_adv takes bits in an int */
+  while(bytes>0){
+    long step=(bytes>(1<<20)?(1<<20):bytes);
+    oggpack_adv(o,step*8);
+    bytes-=step;
+  }
+}
+
+/* The fields are located in a first pass and then copied into a
+   single block, so that reading the comments costs one allocation
+   however many there are, and nothing for the fields that aren't
+   kept. */
+static int _vorbis_unpack_comment(vorbis_comment *vc,oggpack_buffer *opb,
+				  ogg_packet *op){
   int i;
   int vendorlen;
+  long vendoroffset;
+  long size;
+  char *p;
   vendorlen=oggpack_read(opb,32);
   if(vendorlen<0)goto err_out;
   if(vendorlen>opb->storage-oggpack_bytes(opb))goto err_out;
-  vc->vendor=(char *)_ogg_calloc(vendorlen+1,1);
-  if(vc->vendor==NULL)goto err_out;
-  _v_readstring(opb,vc->vendor,vendorlen);
+  vendoroffset=oggpack_bytes(opb);
+  _v_skipbytes(opb,vendorlen);
+  size=vendorlen+1;
   i=oggpack_read(opb,32);
   if(i<0||i>=INT_MAX||i>(opb->storage-oggpack_bytes(opb))>>2)goto err_out;
   vc->user_comments=(char **)_ogg_calloc(i+1,sizeof(*vc->user_comments));
   vc->comment_lengths=(int *)_ogg_calloc(i+1, sizeof(*vc->comment_lengths));
-  if(vc->user_comments==NULL||vc->comment_lengths==NULL)goto err_out;
+  vc->field_lengths=(int *)_ogg_calloc(i+1, sizeof(*vc->field_lengths));
+  vc->field_offsets=(long *)_ogg_calloc(i+1, sizeof(*vc->field_offsets));
+  if(vc->user_comments==NULL||vc->comment_lengths==NULL||
+     vc->field_lengths==NULL||vc->field_offsets==NULL)goto err_out;
   vc->comments=i;
 
   for(i=0;i<vc->comments;i++){
+    const unsigned char *field;
     int len=oggpack_read(opb,32);
     if(len<0||len>opb->storage-oggpack_bytes(opb))goto err_out;
-    vc->comment_lengths[i]=len;
-    vc->user_comments[i]=(char *)_ogg_calloc(len+1,1);
-    if(vc->user_comments[i]==NULL){
-      vc->comments=i;
-      goto err_out;
+    vc->field_lengths[i]=len;
+    vc->field_offsets[i]=oggpack_bytes(opb);
+    field=op->packet+vc->field_offsets[i];
+
+    if(_vorbis_comment_keep(vc,field,len)){
+      vc->comment_lengths[i]=len;
+    }else{
+      int taglen=0;
+      while(taglen<len && field[taglen]!='=')taglen++;
+      vc->comment_lengths[i]=(taglen<len?taglen+1:0);
     }
-    _v_readstring(opb,vc->user_comments[i],len);
+    size+=vc->comment_lengths[i]+1;
+    _v_skipbytes(opb,len);
   }
   if(oggpack_read(opb,1)!=1)goto err_out; /* EOP check */
 
+  p=vc->storage=(char *)_ogg_malloc(size);
+  if(p==NULL)goto err_out;
+  vc->vendor=p;
+  memcpy(p,op->packet+vendoroffset,vendorlen);
+  p[vendorlen]=0;
+  p+=vendorlen+1;
+  for(i=0;i<vc->comments;i++){
+    vc->user_comments[i]=p;
+    memcpy(p,op->packet+vc->field_offsets[i],vc->comment_lengths[i]);
+    p[vc->comment_lengths[i]]=0;
+    p+=vc->comment_lengths[i]+1;
+  }
+
   return(0);
  err_out:
   vorbis_comment_clear(vc);
@@ -235,7 +322,7 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
   ci->books=oggpack_read(opb,8)+1;
   if(ci->books<=0)goto err_out;
   for(i=0;i<ci->books;i++){
-    ci->book_param[i]=vorbis_staticbook_unpack(opb);
+    ci->book_param[i]=vorbis_staticbook_unpack(opb,&ci->arena.allocator);
     if(!ci->book_param[i])goto err_out;
   }
 
@@ -284,7 +371,9 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
   ci->modes=oggpack_read(opb,6)+1;
   if(ci->modes<=0)goto err_out;
   for(i=0;i<ci->modes;i++){
-    ci->mode_param[i]=(vorbis_info_mode *)_ogg_calloc(1,sizeof(*ci->mode_param[i]));
+    ci->mode_param[i]=(vorbis_info_mode *)_vorbis_arena_alloc(&ci->arena,
+					      sizeof(*ci->mode_param[i]));
+    if(!ci->mode_param[i])goto err_out;
     ci->mode_param[i]->blockflag=oggpack_read(opb,1);
     ci->mode_param[i]->windowtype=oggpack_read(opb,16);
     ci->mode_param[i]->transformtype=oggpack_read(opb,16);
@@ -374,7 +463,7 @@ int vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,ogg_packet *op)
           return(OV_EBADHEADER);
         }
 
-	return(_vorbis_unpack_comment(vc,&opb));
+	return(_vorbis_unpack_comment(vc,&opb,op));
 
       case 0x05: /* least significant *bit* is read first */
 	if(vi->rate==0 || vc->vendor==NULL){
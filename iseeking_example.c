@@ -239,6 +239,47 @@ int main(){
       }
     }
     
+    fprintf(stderr,"\r");
+    {
+      /* the index learned above, then a full one, must survive a
+         save and load, and seeks must still land from it */
+      int pass;
+      fprintf(stderr,"testing seek index save and load....\n");
+
+      for(pass=0;pass<2;pass++){
+        long bytes;
+        char *index;
+
+        if(pass && (ret=ov_index_build(&ov,0))<0){
+          fprintf(stderr,"index build failed: %d\n",ret);
+          exit(1);
+        }
+        bytes=ov_index_save(&ov,NULL,0);
+        index=malloc(bytes);
+        if(!index || ov_index_save(&ov,index,bytes)!=bytes){
+          fprintf(stderr,"index save failed\n");
+          exit(1);
+        }
+        if((ret=ov_index_load(&ov,index,bytes))<0){
+          fprintf(stderr,"index load failed: %d\n",ret);
+          exit(1);
+        }
+        free(index);
+
+        for(i=0;i<100;i++){
+          ogg_int64_t val=(double)rand()*pcmlength/RAND_MAX;
+          fprintf(stderr,"\r\t%d [pcm position %ld]...     ",i,(long)val);
+          ret=ov_pcm_seek_page(&ov,val);
+          if(ret<0){
+            fprintf(stderr,"seek failed: %d\n",ret);
+            exit(1);
+          }
+
+          _verify(&ov,-1,val,-1.,pcmlength,bigassbuffer);
+        }
+      }
+    }
+
     fprintf(stderr,"\r                                           \nOK.\n\n");
 
 
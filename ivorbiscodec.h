@@ -53,6 +53,14 @@ typedef struct vorbis_info{
   void *codec_setup;
 } vorbis_info;
 
+/* where a decoder's memory comes from; see vorbis_info_init_alloc().
+   A NULL alloc selects the default allocator. */
+typedef struct vorbis_allocator{
+  void *(*alloc)(void *ctx,size_t bytes);
+  void  (*free) (void *ctx,void *ptr);
+  void  *ctx;
+} vorbis_allocator;
+
 /* vorbis_dsp_state buffers the current vorbis audio
    analysis/synthesis state.  The DSP state belongs to a specific
    logical bitstream ****************************************************/
@@ -82,7 +90,8 @@ typedef struct vorbis_dsp_state{
 
 typedef struct vorbis_block{
   /* necessary stream state for linking to the framing abstraction */
-  ogg_int32_t  **pcm;       /* this is a pointer into local storage */ 
+  ogg_int32_t  **pcm;       /* points into the dsp state's free block
+			       buffer; see vorbis_synthesis() */
   oggpack_buffer opb;
   
   long  lW;
@@ -103,13 +112,15 @@ typedef struct vorbis_block{
   long                localalloc;
   long                totaluse;
   struct alloc_chain *reap;
+  vorbis_allocator    allocator; /* the decoder's; see vorbis_block_init() */
 
 } vorbis_block;
 
 /* vorbis_block is a single block of data to be processed as part of
 the analysis/synthesis stream; it belongs to a specific logical
-bitstream, but is independant from other vorbis_blocks belonging to
-that logical bitstream. *************************************************/
+bitstream.  A decoded block's PCM lives in its dsp state rather than
+in the block, so only one block per dsp state may be decoded ahead of
+vorbis_synthesis_blockin(). ********************************************/
 
 struct alloc_chain{
   void *ptr;
@@ -122,6 +133,11 @@ struct alloc_chain{
    etc). vorbis_info and substructures are in backends.h.
 *********************************************************************/
 
+/* decides whether a comment field, of which taglen bytes come before
+   the '=', is left out of user_comments; nonzero to leave it out */
+typedef int (*vorbis_comment_filter)(void *filter_data,const char *field,
+				     int taglen,int length);
+
 /* the comments are not part of vorbis_info so that vorbis_info can be
    static storage */
 typedef struct vorbis_comment{
@@ -132,8 +148,33 @@ typedef struct vorbis_comment{
   int    comments;
   char  *vendor;
 
+  /* set after vorbis_comment_init() to keep large fields, such as
+     embedded cover art, out of user_comments.  A field longer than
+     max_length bytes (0 for no limit) or turned down by the filter
+     appears as just its "TAG=", and can be read from the header
+     packet with vorbis_comment_fetch(). */
+  int                    max_length;
+  vorbis_comment_filter  filter;
+  void                  *filter_data;
+
+  /* each field's full length and offset in the comment packet */
+  int                   *field_lengths;
+  long                  *field_offsets;
+  char                  *storage;
+
 } vorbis_comment;
 
+/* bytes held by a decoder, by what they're for; see
+   vorbis_memory_usage() */
+typedef struct vorbis_memory{
+  long setup;      /* setup header contents, besides the codebooks */
+  long codebooks;  /* static codebooks, or the decode books built from them */
+  long lookups;    /* floor, residue and mapping lookups; transform tables */
+  long pcm;        /* PCM and overlap buffers */
+  long block;      /* per-packet scratch */
+  long comments;
+} vorbis_memory;
+
 
 /* libvorbis encodes in two abstraction layers; first we perform DSP
    and produce a packet (see docs/analysis.txt).  The packet is then
@@ -150,16 +191,23 @@ typedef struct vorbis_comment{
 /* Vorbis PRIMITIVES: general ***************************************/
 
 extern void     vorbis_info_init(vorbis_info *vi);
+extern void     vorbis_info_init_alloc(vorbis_info *vi,
+				       const vorbis_allocator *allocator);
 extern void     vorbis_info_clear(vorbis_info *vi);
 extern int      vorbis_info_blocksize(vorbis_info *vi,int zo);
 extern void     vorbis_comment_init(vorbis_comment *vc);
 extern char    *vorbis_comment_query(vorbis_comment *vc, char *tag, int count);
 extern int      vorbis_comment_query_count(vorbis_comment *vc, char *tag);
 extern void     vorbis_comment_clear(vorbis_comment *vc);
+extern int      vorbis_comment_fetch(vorbis_comment *vc,ogg_packet *op,int i,
+				     char *buffer,int bytes);
 
 extern int      vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb);
 extern int      vorbis_block_clear(vorbis_block *vb);
 extern void     vorbis_dsp_clear(vorbis_dsp_state *v);
+extern void     vorbis_memory_usage(vorbis_info *vi,vorbis_comment *vc,
+				    vorbis_dsp_state *v,vorbis_block *vb,
+				    vorbis_memory *m);
 
 /* Vorbis PRIMITIVES: synthesis layer *******************************/
 extern int      vorbis_synthesis_idheader(ogg_packet *op);
@@ -167,19 +215,35 @@ extern int      vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,
 					  ogg_packet *op);
 
 extern int      vorbis_synthesis_init(vorbis_dsp_state *v,vorbis_info *vi);
+extern int      vorbis_synthesis_init_slab(vorbis_dsp_state *v,vorbis_info *vi,
+					   void *slab,long bytes);
+extern long     vorbis_synthesis_memory(vorbis_info *vi);
 extern int      vorbis_synthesis_restart(vorbis_dsp_state *v);
+/* vorbis_synthesis() decodes into the dsp state's free block buffer and
+   vorbis_synthesis_blockin() laps it in place there, so each decoded
+   block must be passed to blockin before another block is decoded
+   with the same dsp state.  vb->pcm is valid only until then. */
 extern int      vorbis_synthesis(vorbis_block *vb,ogg_packet *op);
 extern int      vorbis_synthesis_trackonly(vorbis_block *vb,ogg_packet *op);
 extern int      vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb);
 extern int      vorbis_synthesis_pcmout(vorbis_dsp_state *v,ogg_int32_t ***pcm);
 extern int      vorbis_synthesis_read(vorbis_dsp_state *v,int samples);
 extern long     vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op);
+extern long     vorbis_packet_nextblocksize(vorbis_info *vi,ogg_packet *op);
+
+extern int      vorbis_synthesis_halfrate(vorbis_info *v,int flag);
+extern int      vorbis_synthesis_halfrate_p(vorbis_info *v);
+extern int      vorbis_synthesis_preview(vorbis_info *v,int stages);
+extern int      vorbis_synthesis_preview_p(vorbis_info *v);
+extern int      vorbis_synthesis_lowaccuracy(vorbis_info *v,int flag);
+extern int      vorbis_synthesis_lowaccuracy_p(vorbis_info *v);
 
 /* Vorbis ERRORS and return codes ***********************************/
 
 #define OV_FALSE      -1  
 #define OV_EOF        -2
 #define OV_HOLE       -3
+#define OV_NEEDDATA   -4
 
 #define OV_EREAD      -128
 #define OV_EFAULT     -129
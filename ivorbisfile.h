@@ -28,6 +28,26 @@ extern "C"
 
 #define CHUNKSIZE 65535
 #define READSIZE  1024
+#define READSIZE_MAX 65536 /* default limit for sequential reads to grow to */
+
+/* decoded pcm is fixed point with this many fraction bits; full scale
+   (1.0) is 1<<OV_FIXED_FRACBITS, leaving headroom for overshoot */
+#define OV_FIXED_FRACBITS 24
+
+/* sample encodings for ov_read_format() */
+#define OV_FMT_U8      0
+#define OV_FMT_S16     1
+#define OV_FMT_S24     2  /* packed, three bytes per sample */
+#define OV_FMT_S32     3
+#define OV_FMT_FLOAT32 4
+
+typedef struct {
+  int encoding;   /* one of OV_FMT_* */
+  int bigendianp; /* nonzero for big endian words; ignored for OV_FMT_U8 */
+  int planar;     /* nonzero to return each channel contiguously
+		     rather than interleaved */
+} ov_format;
+
 /* The function prototypes for the callbacks are basically the same as for
  * the stdio functions fread, fseek, fclose, ftell.
  * The one difference is that the FILE * arguments have been replaced with
@@ -45,6 +65,38 @@ typedef struct {
   long   (*tell_func)  (void *datasource);
 } ov_callbacks;
 
+/* calls made through ov_callbacks since open; see ov_io_stats() */
+typedef struct {
+  ogg_int64_t read_calls;
+  ogg_int64_t read_bytes;
+  ogg_int64_t seek_calls;
+
+  /* the most recent search for a page by granulepos */
+  long        seek_probes;
+  ogg_int64_t seek_bytes;
+} ov_io_counters;
+
+/* bytes an OggVorbis_File holds; see ov_memory_usage() */
+typedef struct {
+  long setup;      /* each link's setup, besides its codebooks */
+  long codebooks;  /* each link's codebooks */
+  long lookups;    /* the decoder's lookup and transform tables */
+  long pcm;        /* the decoder's PCM and overlap buffers */
+  long block;      /* the decoder's per-packet scratch */
+  long comments;   /* each link's comments */
+  long ogg;        /* Ogg sync and stream buffers */
+  long links;      /* link tables and seek index */
+  long total;
+} ov_memory_breakdown;
+
+/* a page with a granulepos, as remembered by the seek index */
+typedef struct {
+  int         link;
+  ogg_int64_t granulepos;
+  ogg_int64_t offset;  /* of the page */
+  ogg_int64_t next;    /* of the page following it */
+} ov_index_entry;
+
 #define  NOTOPEN   0
 #define  PARTOPEN  1
 #define  OPENED    2
@@ -84,19 +136,85 @@ typedef struct OggVorbis_File {
 
   ov_callbacks callbacks;
 
+  /* read_func request size: starts at read_min after every seek and
+     doubles with each further read, up to read_max */
+  long             read_min;
+  long             read_max;
+  long             read_size;
+  ov_io_counters   io;
+
+  /* seek index, sorted by link then granulepos; see ov_index_build() */
+  ov_index_entry  *index;
+  long             index_entries;
+  long             index_alloc;
+
+  /* opened with ov_open_callbacks_fast(); read as a stream until the
+     links are needed */
+  int              deferred;
+
+  /* fed by ov_push_data() instead of callbacks: 1, or 2 once the end
+     of the data has been pushed; push_headers counts the header
+     packets of the link being set up */
+  int              push;
+  int              push_headers;
+
+  /* comment limits for each link; see ov_open_callbacks_limit() */
+  int                    comment_max;
+  vorbis_comment_filter  comment_filter;
+  void                  *comment_filter_data;
+
+  /* where each link's decoder memory comes from; see
+     ov_open_callbacks_alloc() */
+  vorbis_allocator       allocator;
+
 } OggVorbis_File;
 
+/* one file for ov_batch_decode() */
+typedef struct {
+  /* source: a path, or else a datasource and callbacks as for
+     ov_open_callbacks() */
+  const char      *path;
+  void            *datasource;
+  ov_callbacks     callbacks;
+
+  /* sink for the decoded PCM as ov_read() returns it; a nonzero
+     return ends the job with that result */
+  int            (*write_func)(void *sink,const char *buffer,long bytes);
+  void            *sink;
+
+  /* filled in when the job is done */
+  int              result;
+  ogg_int64_t      samples;
+  ogg_int64_t      bytes_in;
+  ogg_int64_t      usec;
+} ov_batch_job;
+
 extern int ov_clear(OggVorbis_File *vf);
 extern int ov_fopen(const char *path,OggVorbis_File *vf);
 extern int ov_open(FILE *f,OggVorbis_File *vf,const char *initial,long ibytes);
+extern int ov_open_memory(const void *buffer,long bytes,OggVorbis_File *vf);
+extern int ov_open_mmap(const char *path,OggVorbis_File *vf);
 extern int ov_open_callbacks(void *datasource, OggVorbis_File *vf,
 		const char *initial, long ibytes, ov_callbacks callbacks);
+extern int ov_open_callbacks_fast(void *datasource, OggVorbis_File *vf,
+		const char *initial, long ibytes, ov_callbacks callbacks);
+extern int ov_open_callbacks_limit(void *datasource, OggVorbis_File *vf,
+		const char *initial, long ibytes, ov_callbacks callbacks,
+		int max_length, vorbis_comment_filter filter, void *filter_data);
+extern int ov_open_callbacks_alloc(void *datasource, OggVorbis_File *vf,
+		const char *initial, long ibytes, ov_callbacks callbacks,
+		const vorbis_allocator *allocator);
+extern int ov_push_open(OggVorbis_File *vf);
+extern int ov_push_data(OggVorbis_File *vf,const void *buffer,long bytes);
 
 extern int ov_test(FILE *f,OggVorbis_File *vf,const char *initial,long ibytes);
 extern int ov_test_callbacks(void *datasource, OggVorbis_File *vf,
 		const char *initial, long ibytes, ov_callbacks callbacks);
 extern int ov_test_open(OggVorbis_File *vf);
 
+extern int ov_probe(void *datasource,ov_callbacks callbacks,vorbis_info *vi,
+		vorbis_comment *vc,ogg_int64_t *pcm_total);
+
 extern long ov_bitrate(OggVorbis_File *vf,int i);
 extern long ov_bitrate_instant(OggVorbis_File *vf);
 extern long ov_streams(OggVorbis_File *vf);
@@ -113,15 +231,38 @@ extern int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos);
 extern int ov_time_seek(OggVorbis_File *vf,ogg_int64_t pos);
 extern int ov_time_seek_page(OggVorbis_File *vf,ogg_int64_t pos);
 
+extern int ov_index_build(OggVorbis_File *vf,ogg_int64_t spacing);
+extern long ov_index_save(OggVorbis_File *vf,void *buffer,long bytes);
+extern int ov_index_load(OggVorbis_File *vf,const void *buffer,long bytes);
+
 extern ogg_int64_t ov_raw_tell(OggVorbis_File *vf);
 extern ogg_int64_t ov_pcm_tell(OggVorbis_File *vf);
 extern ogg_int64_t ov_time_tell(OggVorbis_File *vf);
 
+extern int ov_read_policy(OggVorbis_File *vf,long minsize,long maxsize);
+extern int ov_io_stats(OggVorbis_File *vf,ov_io_counters *counters);
+extern long ov_memory_required(OggVorbis_File *vf,int i);
+extern int ov_memory_usage(OggVorbis_File *vf,ov_memory_breakdown *breakdown);
+
+extern int ov_halfrate(OggVorbis_File *vf,int flag);
+extern int ov_halfrate_p(OggVorbis_File *vf);
+extern int ov_preview(OggVorbis_File *vf,int stages);
+extern int ov_lowaccuracy(OggVorbis_File *vf,int flag);
+extern int ov_lowaccuracy_p(OggVorbis_File *vf);
+
 extern vorbis_info *ov_info(OggVorbis_File *vf,int link);
 extern vorbis_comment *ov_comment(OggVorbis_File *vf,int link);
+extern int ov_comment_fetch(OggVorbis_File *vf,int link,int i,
+		char *buffer,int bytes);
 
 extern long ov_read(OggVorbis_File *vf,char *buffer,int length,
 		    int *bitstream);
+extern long ov_read_fixed(OggVorbis_File *vf,ogg_int32_t ***pcm_channels,
+			  int length,int *bitstream);
+extern long ov_read_format(OggVorbis_File *vf,char *buffer,int length,
+			   const ov_format *format,int *bitstream);
+
+extern int ov_batch_decode(ov_batch_job *jobs,int n,int threads);
 
 #ifdef __cplusplus
 }
@@ -26,6 +26,7 @@
 #include "window.h"
 #include "registry.h"
 #include "misc.h"
+#include "block.h"
 
 /* simplistic, wasteful way of doing this (unique lookup for each
    mode/submapping); there should be a central repository for
@@ -52,54 +53,29 @@ typedef struct {
 		     invalidate decay */
 } vorbis_look_mapping0;
 
-static void mapping0_free_info(vorbis_info_mapping *i){
-  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)i;
-  if(info){
-    memset(info,0,sizeof(*info));
-    _ogg_free(info);
-  }
-}
-
-static void mapping0_free_look(vorbis_look_mapping *look){
-  int i;
-  vorbis_look_mapping0 *l=(vorbis_look_mapping0 *)look;
-  if(l){
-
-    for(i=0;i<l->map->submaps;i++){
-      l->floor_func[i]->free_look(l->floor_look[i]);
-      l->residue_func[i]->free_look(l->residue_look[i]);
-    }
-
-    _ogg_free(l->floor_func);
-    _ogg_free(l->residue_func);
-    _ogg_free(l->floor_look);
-    _ogg_free(l->residue_look);
-    memset(l,0,sizeof(*l));
-    _ogg_free(l);
-  }
-}
-
 static vorbis_look_mapping *mapping0_look(vorbis_dsp_state *vd,vorbis_info_mode *vm,
 			  vorbis_info_mapping *m){
   int i;
   vorbis_info          *vi=vd->vi;
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
-  vorbis_look_mapping0 *look=(vorbis_look_mapping0 *)_ogg_calloc(1,sizeof(*look));
+  vorbis_arena         *arena=&((private_state *)vd->backend_state)->arena;
+  vorbis_look_mapping0 *look=(vorbis_look_mapping0 *)_vorbis_arena_alloc(arena,sizeof(*look));
   vorbis_info_mapping0 *info=look->map=(vorbis_info_mapping0 *)m;
   look->mode=vm;
   
-  look->floor_look=(vorbis_look_floor **)_ogg_calloc(info->submaps,sizeof(*look->floor_look));
+  look->floor_look=(vorbis_look_floor **)_vorbis_arena_alloc(arena,info->submaps*sizeof(*look->floor_look));
 
-  look->residue_look=(vorbis_look_residue **)_ogg_calloc(info->submaps,sizeof(*look->residue_look));
+  look->residue_look=(vorbis_look_residue **)_vorbis_arena_alloc(arena,info->submaps*sizeof(*look->residue_look));
 
-  look->floor_func=(vorbis_func_floor **)_ogg_calloc(info->submaps,sizeof(*look->floor_func));
-  look->residue_func=(vorbis_func_residue **)_ogg_calloc(info->submaps,sizeof(*look->residue_func));
+  look->floor_func=(vorbis_func_floor **)_vorbis_arena_alloc(arena,info->submaps*sizeof(*look->floor_func));
+  look->residue_func=(vorbis_func_residue **)_vorbis_arena_alloc(arena,info->submaps*sizeof(*look->residue_func));
   
   for(i=0;i<info->submaps;i++){
     int floornum=info->floorsubmap[i];
     int resnum=info->residuesubmap[i];
 
-    look->floor_func[i]=_floor_P[ci->floor_type[floornum]];
+    look->floor_func[i]=(ci->lowaccuracy_flag?_floor_P_low:_floor_P)
+      [ci->floor_type[floornum]];
     look->floor_look[i]=look->floor_func[i]->
       look(vd,vm,ci->floor_param[floornum]);
     look->residue_func[i]=_residue_P[ci->residue_type[resnum]];
@@ -113,6 +89,32 @@ static vorbis_look_mapping *mapping0_look(vorbis_dsp_state *vd,vorbis_info_mode
   return(look);
 }
 
+/* what mapping0_look() and the floor and residue looks it makes take
+   from the dsp arena */
+static long mapping0_look_bytes(vorbis_info *vi,vorbis_info_mode *vm,
+				vorbis_info_mapping *m){
+  int i;
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)m;
+  long bytes=ARENA_BYTES(sizeof(vorbis_look_mapping0));
+
+  bytes+=ARENA_BYTES(info->submaps*sizeof(vorbis_look_floor *));
+  bytes+=ARENA_BYTES(info->submaps*sizeof(vorbis_look_residue *));
+  bytes+=ARENA_BYTES(info->submaps*sizeof(vorbis_func_floor *));
+  bytes+=ARENA_BYTES(info->submaps*sizeof(vorbis_func_residue *));
+
+  for(i=0;i<info->submaps;i++){
+    int floornum=info->floorsubmap[i];
+    int resnum=info->residuesubmap[i];
+
+    bytes+=(ci->lowaccuracy_flag?_floor_P_low:_floor_P)
+      [ci->floor_type[floornum]]->look_bytes(vi,vm,ci->floor_param[floornum]);
+    bytes+=_residue_P[ci->residue_type[resnum]]->
+      look_bytes(vi,vm,ci->residue_param[resnum]);
+  }
+  return(bytes);
+}
+
 static int ilog(unsigned int v){
   int ret=0;
   if(v)--v;
@@ -126,8 +128,10 @@ static int ilog(unsigned int v){
 /* also responsible for range checking */
 static vorbis_info_mapping *mapping0_unpack(vorbis_info *vi,oggpack_buffer *opb){
   int i,b;
-  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)_ogg_calloc(1,sizeof(*info));
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)
+    _vorbis_arena_alloc(&ci->arena,sizeof(*info));
+  if(!info)goto err_out;
 
   b=oggpack_read(opb,1);
   if(b<0)goto err_out;
@@ -176,11 +180,9 @@ static vorbis_info_mapping *mapping0_unpack(vorbis_info *vi,oggpack_buffer *opb)
   return info;
 
  err_out:
-  mapping0_free_info(info);
   return(NULL);
 }
 
-static int seq=0;
 static int mapping0_inverse(vorbis_block *vb,vorbis_look_mapping *l){
   vorbis_dsp_state     *vd=vb->vd;
   vorbis_info          *vi=vd->vi;
@@ -191,12 +193,16 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_look_mapping *l){
 
   int                   i,j;
   long                  n=vb->pcmend=ci->blocksizes[vb->W];
+  long                  blocksizes[2];
 
-  VAR_STACK(ogg_int32_t *, pcmbundle, vi->channels);
-  VAR_STACK(int, zerobundle, vi->channels);
+  /* channel-sized working arrays come from the block, not the stack;
+     a stream may have 255 channels */
+  ogg_int32_t **pcmbundle=(ogg_int32_t **)
+    _vorbis_block_alloc(vb,vi->channels*sizeof(*pcmbundle));
+  int *zerobundle=(int *)_vorbis_block_alloc(vb,vi->channels*sizeof(*zerobundle));
   
-  VAR_STACK(int, nonzero, vi->channels);
-  VAR_STACK(void *, floormemo, vi->channels);
+  int *nonzero=(int *)_vorbis_block_alloc(vb,vi->channels*sizeof(*nonzero));
+  void **floormemo=(void **)_vorbis_block_alloc(vb,vi->channels*sizeof(*floormemo));
   
   /* time domain information decode (note that applying the
      information would have to happen later; we'll probably add a
@@ -237,8 +243,11 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_look_mapping *l){
       }
     }
     
+    /* residue is the last thing in the packet, so the final submap
+       may stop short of the full cascade without losing sync */
     look->residue_func[i]->inverse(vb,look->residue_look[i],
-				   pcmbundle,zerobundle,ch_in_bundle);
+				   pcmbundle,zerobundle,ch_in_bundle,
+				   i==info->submaps-1?ci->preview_stages:0);
   }
 
   //for(j=0;j<vi->channels;j++)
@@ -291,36 +300,70 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_look_mapping *l){
   /* only MDCT right now.... */
   for(i=0;i<vi->channels;i++){
     ogg_int32_t *pcm=vb->pcm[i];
-    mdct_backward(n,pcm,pcm);
+    if(nonzero[i])
+      b->mdct_backward((mdct_lookup *)b->transform[vb->W],pcm,pcm);
   }
 
   //for(j=0;j<vi->channels;j++)
   //_analysis_output("imdct",seq+j,vb->pcm[j],-24,n,0,0);
 
-  /* window the data */
+  /* window the data; in halfrate mode the transform output, and so
+     the window, is half the coded blocksize.  Silent channels skipped
+     the transform and only need zeros where the window is nonzero. */
+  blocksizes[0]=ci->blocksizes[0]>>ci->halfrate_flag;
+  blocksizes[1]=ci->blocksizes[1]>>ci->halfrate_flag;
   for(i=0;i<vi->channels;i++){
     ogg_int32_t *pcm=vb->pcm[i];
     if(nonzero[i])
-      _vorbis_apply_window(pcm,b->window,ci->blocksizes,vb->lW,vb->W,vb->nW);
-    else
-      for(j=0;j<n;j++)
-	pcm[j]=0;
-    
+      b->apply_window(pcm,b->window,blocksizes,vb->lW,vb->W,vb->nW);
+    else{
+      long bn=blocksizes[vb->W];
+      long leftbegin=bn/4-blocksizes[vb->lW]/4;
+      long rightend=bn/2+bn/4+blocksizes[vb->nW]/4;
+      memset(pcm+leftbegin,0,sizeof(*pcm)*(rightend-leftbegin));
+    }
   }
 
   //for(j=0;j<vi->channels;j++)
   //_analysis_output("window",seq+j,vb->pcm[j],-24,n,0,0);
 
-  seq+=vi->channels;
   /* all done! */
   return(0);
 }
 
+/* the most mapping0_inverse() takes from the block for one packet;
+   every channel's floor is held until the residue is in */
+static long mapping0_inverse_bytes(vorbis_info *vi,vorbis_info_mode *vm,
+				   vorbis_info_mapping *m){
+  int i,j;
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)m;
+  long bytes=ARENA_BYTES(vi->channels*sizeof(ogg_int32_t *))+
+    2*ARENA_BYTES(vi->channels*sizeof(int))+
+    ARENA_BYTES(vi->channels*sizeof(void *));
+
+  for(i=0;i<vi->channels;i++){
+    int floornum=info->floorsubmap[info->chmuxlist[i]];
+    bytes+=(ci->lowaccuracy_flag?_floor_P_low:_floor_P)
+      [ci->floor_type[floornum]]->inverse_bytes(vi,ci->floor_param[floornum]);
+  }
+
+  for(i=0;i<info->submaps;i++){
+    int resnum=info->residuesubmap[i];
+    int ch_in_bundle=0;
+    for(j=0;j<vi->channels;j++)
+      if(info->chmuxlist[j]==i)ch_in_bundle++;
+    bytes+=_residue_P[ci->residue_type[resnum]]->
+      inverse_bytes(vi,vm,ci->residue_param[resnum],ch_in_bundle);
+  }
+  return(bytes);
+}
+
 /* export hooks */
 vorbis_func_mapping mapping0_exportbundle={
   &mapping0_unpack,
   &mapping0_look,
-  &mapping0_free_info,
-  &mapping0_free_look,
-  &mapping0_inverse
+  &mapping0_look_bytes,
+  &mapping0_inverse,
+  &mapping0_inverse_bytes
 };
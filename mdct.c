@@ -32,6 +32,7 @@
 
  ********************************************************************/
 
+#include <string.h>
 #include "ivorbiscodec.h"
 #include "codebook.h"
 #include "misc.h"
@@ -337,7 +338,60 @@ STIN void mdct_bitreverse(DATA_TYPE *x,int n,int step,int shift){
   }while(w0<w1);
 }
 
-void mdct_backward(int n, DATA_TYPE *in, DATA_TYPE *out){
+#ifndef _LOW_ACCURACY_
+/* {sin(r*PI/16384), cos(r*PI/16384)}, with r = 1 to 3 */
+static const ogg_int32_t sincos_fine[6] = {
+  0x0006487f, 0x7fffffd9, 0x000c90fe, 0x7fffff62,
+  0x0012d97c, 0x7ffffe9d,
+};
+#endif
+
+/* The final rotate of mdct_backward needs {sin,cos} of (2i+1)*PI/(2n).
+   sincos_lookup0/1 hold those directly for n<=2048; for the larger
+   blocksizes the angles fall between table entries.  Rather than
+   interpolating in the inner loop, rotate the nearest table entry by
+   the remaining (small, fixed) angle once here.  In low accuracy
+   builds the tables are too coarse for this to matter, and the
+   interpolating paths are kept. */
+void mdct_init(mdct_lookup *lookup,int n,vorbis_arena *arena){
+  memset(lookup,0,sizeof(*lookup));
+  lookup->n=n;
+
+#ifndef _LOW_ACCURACY_
+  if(n>2048 && n<=8192){
+    int n4=n>>2;
+    int mul=8192/n;
+    int i;
+    LOOKUP_T *T=lookup->trig=(LOOKUP_T *)_vorbis_arena_alloc(arena,n4*2*sizeof(*T));
+    if(!T)return;
+
+    for(i=0;i<n4;i++){
+      /* angle in units of PI/16384; the table grid is every 4 units */
+      int m=(2*i+1)*mul;
+      int g=m>>2;
+      const LOOKUP_T *B=(g&1)?sincos_lookup1+g-1:sincos_lookup0+g;
+      ogg_int64_t s=B[0];
+      ogg_int64_t c=B[1];
+      ogg_int64_t sr=sincos_fine[((m&3)-1)*2];
+      ogg_int64_t cr=sincos_fine[((m&3)-1)*2+1];
+
+      T[i*2]  =(LOOKUP_T)((s*cr + c*sr + (1<<30))>>31);
+      T[i*2+1]=(LOOKUP_T)((c*cr - s*sr + (1<<30))>>31);
+    }
+  }
+#endif
+}
+
+/* what mdct_init() takes from the arena for blocksize n */
+long mdct_bytes(int n){
+#ifndef _LOW_ACCURACY_
+  if(n>2048 && n<=8192)return(ARENA_BYTES((n>>2)*2*sizeof(LOOKUP_T)));
+#endif
+  return(0);
+}
+
+void mdct_backward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
+  int n=init->n;
   int n2=n>>1;
   int n4=n>>2;
   DATA_TYPE *iX;
@@ -398,9 +452,15 @@ void mdct_backward(int n, DATA_TYPE *in, DATA_TYPE *out){
     DATA_TYPE *oX2=out+n2+n4;
     DATA_TYPE *iX =out;
 
+    if(init->trig){
+      /* exact twiddles for this blocksize, see mdct_init() */
+      T=init->trig;
+      step=2;
+    }else
+      T=(step>=4)?(sincos_lookup0+(step>>1)):sincos_lookup1;
+
     switch(step) {
       default: {
-        T=(step>=4)?(sincos_lookup0+(step>>1)):sincos_lookup1;
         do{
           oX1-=4;
 	  XPROD31( iX[0], -iX[1], T[0], T[1], &oX1[3], &oX2[0] ); T+=step;
@@ -34,8 +34,22 @@
 #define cPI1_8 (0x7641af3d)
 #endif
 
+typedef struct {
+  int n;
+  LOOKUP_T *trig; /* exact final-rotate twiddles, NULL if not needed */
+} mdct_lookup;
+
+extern void mdct_init(mdct_lookup *lookup,int n,vorbis_arena *arena);
+extern long mdct_bytes(int n);
 extern void mdct_forward(int n, DATA_TYPE *in, DATA_TYPE *out);
-extern void mdct_backward(int n, DATA_TYPE *in, DATA_TYPE *out);
+extern void mdct_backward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out);
+
+#ifndef _LOW_ACCURACY_
+/* the same transform built with _LOW_ACCURACY_, see mdct_low.c */
+extern void mdct_init_low(mdct_lookup *lookup,int n,vorbis_arena *arena);
+extern long mdct_bytes_low(int n);
+extern void mdct_backward_low(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out);
+#endif
 
 #endif
 
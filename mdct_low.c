@@ -0,0 +1,29 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis 'TREMOR' CODEC SOURCE CODE.   *
+ *                                                                  *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis 'TREMOR' SOURCE CODE IS (C) COPYRIGHT 1994-2002    *
+ * BY THE Xiph.Org FOUNDATION http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: low accuracy inverse MDCT
+
+ ********************************************************************/
+
+/* The same source as mdct.c, built a second time with _LOW_ACCURACY_
+   and renamed, so a decoder can pick the 32 bit kernels at setup
+   (see vorbis_synthesis_lowaccuracy()).  A library built with
+   _LOW_ACCURACY_ throughout has only those and needs no copy. */
+
+#ifndef _LOW_ACCURACY_
+#define _LOW_ACCURACY_
+#define mdct_init     mdct_init_low
+#define mdct_bytes    mdct_bytes_low
+#define mdct_backward mdct_backward_low
+#include "mdct.c"
+#endif
@@ -30,6 +30,35 @@
 
 #include "asm_arm.h"
 #include <stdlib.h> /* for abs() */
+
+/* storage for objects that live as long as a decoder's setup or its
+   dsp state.  Nothing in an arena is freed on its own; it is carved
+   from chunks that all go at once when the arena is cleared.  See
+   block.c. */
+typedef struct vorbis_arena{
+  vorbis_allocator    allocator;
+  void               *chunks;   /* most recent first */
+  char               *top;
+  long                left;
+  long                size;     /* bytes of all chunks, caller's included */
+} vorbis_arena;
+
+#ifndef WORD_ALIGN
+#define WORD_ALIGN 8
+#endif
+
+/* what _vorbis_arena_alloc() takes from an arena for a request, for
+   sizing an arena ahead of time; see vorbis_synthesis_memory() */
+#define ARENA_BYTES(bytes) (((long)(bytes)+(WORD_ALIGN-1)) & ~(long)(WORD_ALIGN-1))
+
+extern void *_vorbis_malloc(const vorbis_allocator *a,long bytes);
+extern void  _vorbis_free(const vorbis_allocator *a,void *ptr);
+extern void  _vorbis_arena_init(vorbis_arena *arena,
+				const vorbis_allocator *allocator);
+extern int   _vorbis_arena_reserve(vorbis_arena *arena,long bytes);
+extern void  _vorbis_arena_use(vorbis_arena *arena,void *buffer,long bytes);
+extern void *_vorbis_arena_alloc(vorbis_arena *arena,long bytes);
+extern void  _vorbis_arena_clear(vorbis_arena *arena);
   
 #ifndef _V_WIDE_MATH
 #define _V_WIDE_MATH
@@ -37,6 +37,12 @@
 #  else
 #    define STIN static
 #  endif
+
+#  if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER>=1400)
+#    define OV_RESTRICT __restrict
+#  else
+#    define OV_RESTRICT
+#  endif
 #endif
 
 #ifdef _WIN32
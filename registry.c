@@ -36,6 +36,22 @@ vorbis_func_floor     *_floor_P[]={
   &floor1_exportbundle,
 };
 
+/* floors for decoders set up with vorbis_synthesis_lowaccuracy() */
+#ifndef _LOW_ACCURACY_
+extern vorbis_func_floor     floor0_exportbundle_low;
+extern vorbis_func_floor     floor1_exportbundle_low;
+
+vorbis_func_floor     *_floor_P_low[]={
+  &floor0_exportbundle_low,
+  &floor1_exportbundle_low,
+};
+#else
+vorbis_func_floor     *_floor_P_low[]={
+  &floor0_exportbundle,
+  &floor1_exportbundle,
+};
+#endif
+
 vorbis_func_residue   *_residue_P[]={
   &residue0_exportbundle,
   &residue1_exportbundle,
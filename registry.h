@@ -34,6 +34,7 @@
 #endif
 
 EXTERN vorbis_func_floor     *_floor_P[];
+EXTERN vorbis_func_floor     *_floor_P_low[];
 EXTERN vorbis_func_residue   *_residue_P[];
 EXTERN vorbis_func_mapping   *_mapping_P[];
 
@@ -41,32 +41,6 @@ typedef struct {
 
 } vorbis_look_residue0;
 
-void res0_free_info(vorbis_info_residue *i){
-  vorbis_info_residue0 *info=(vorbis_info_residue0 *)i;
-  if(info){
-    memset(info,0,sizeof(*info));
-    _ogg_free(info);
-  }
-}
-
-void res0_free_look(vorbis_look_residue *i){
-  int j;
-  if(i){
-
-    vorbis_look_residue0 *look=(vorbis_look_residue0 *)i;
-
-    for(j=0;j<look->parts;j++)
-      if(look->partbooks[j])_ogg_free(look->partbooks[j]);
-    _ogg_free(look->partbooks);
-    for(j=0;j<look->partvals;j++)
-      _ogg_free(look->decodemap[j]);
-    _ogg_free(look->decodemap);
-
-    memset(look,0,sizeof(*look));
-    _ogg_free(look);
-  }
-}
-
 static int ilog(unsigned int v){
   int ret=0;
   while(v){
@@ -88,8 +62,10 @@ static int icount(unsigned int v){
 /* vorbis_info is for range checking */
 vorbis_info_residue *res0_unpack(vorbis_info *vi,oggpack_buffer *opb){
   int j,acc=0;
-  vorbis_info_residue0 *info=(vorbis_info_residue0 *)_ogg_calloc(1,sizeof(*info));
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  vorbis_info_residue0 *info=(vorbis_info_residue0 *)
+    _vorbis_arena_alloc(&ci->arena,sizeof(*info));
+  if(!info)goto errout;
 
   info->begin=oggpack_read(opb,24);
   info->end=oggpack_read(opb,24);
@@ -146,14 +122,14 @@ vorbis_info_residue *res0_unpack(vorbis_info *vi,oggpack_buffer *opb){
 
   return(info);
  errout:
-  res0_free_info(info);
   return(NULL);
 }
 
 vorbis_look_residue *res0_look(vorbis_dsp_state *vd,vorbis_info_mode *vm,
 			  vorbis_info_residue *vr){
   vorbis_info_residue0 *info=(vorbis_info_residue0 *)vr;
-  vorbis_look_residue0 *look=(vorbis_look_residue0 *)_ogg_calloc(1,sizeof(*look));
+  vorbis_arena         *arena=&((private_state *)vd->backend_state)->arena;
+  vorbis_look_residue0 *look=(vorbis_look_residue0 *)_vorbis_arena_alloc(arena,sizeof(*look));
   codec_setup_info     *ci=(codec_setup_info *)vd->vi->codec_setup;
 
   int j,k,acc=0;
@@ -167,13 +143,13 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,vorbis_info_mode *vm,
   look->phrasebook=ci->fullbooks+info->groupbook;
   dim=look->phrasebook->dim;
 
-  look->partbooks=(codebook ***)_ogg_calloc(look->parts,sizeof(*look->partbooks));
+  look->partbooks=(codebook ***)_vorbis_arena_alloc(arena,look->parts*sizeof(*look->partbooks));
 
   for(j=0;j<look->parts;j++){
     int stages=ilog(info->secondstages[j]);
     if(stages){
       if(stages>maxstage)maxstage=stages;
-      look->partbooks[j]=(codebook **)_ogg_calloc(stages,sizeof(*look->partbooks[j]));
+      look->partbooks[j]=(codebook **)_vorbis_arena_alloc(arena,stages*sizeof(*look->partbooks[j]));
       for(k=0;k<stages;k++)
 	if(info->secondstages[j]&(1<<k)){
 	  look->partbooks[j][k]=ci->fullbooks+info->booklist[acc++];
@@ -188,11 +164,11 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,vorbis_info_mode *vm,
   look->partvals=look->parts;
   for(j=1;j<dim;j++)look->partvals*=look->parts;
   look->stages=maxstage;
-  look->decodemap=(int **)_ogg_malloc(look->partvals*sizeof(*look->decodemap));
+  look->decodemap=(int **)_vorbis_arena_alloc(arena,look->partvals*sizeof(*look->decodemap));
   for(j=0;j<look->partvals;j++){
     long val=j;
     long mult=look->partvals/look->parts;
-    look->decodemap[j]=(int *)_ogg_malloc(dim*sizeof(*look->decodemap[j]));
+    look->decodemap[j]=(int *)_vorbis_arena_alloc(arena,dim*sizeof(*look->decodemap[j]));
     for(k=0;k<dim;k++){
       long deco=val/mult;
       val-=deco*mult;
@@ -204,16 +180,46 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,vorbis_info_mode *vm,
   return(look);
 }
 
+/* what res0_look() takes from the dsp arena; the codebooks may not be
+   built yet */
+long res0_look_bytes(vorbis_info *vi,vorbis_info_mode *vm,
+		     vorbis_info_residue *vr){
+  vorbis_info_residue0 *info=(vorbis_info_residue0 *)vr;
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  long bytes=ARENA_BYTES(sizeof(vorbis_look_residue0));
+  int j,dim,partvals;
+
+  dim=(ci->fullbooks?ci->fullbooks[info->groupbook].dim:
+       ci->book_param[info->groupbook]->dim);
+
+  bytes+=ARENA_BYTES(info->partitions*sizeof(codebook **));
+  for(j=0;j<info->partitions;j++){
+    int stages=ilog(info->secondstages[j]);
+    if(stages)bytes+=ARENA_BYTES(stages*sizeof(codebook *));
+  }
+
+  partvals=info->partitions;
+  for(j=1;j<dim;j++)partvals*=info->partitions;
+  bytes+=ARENA_BYTES(partvals*sizeof(int *));
+  bytes+=partvals*ARENA_BYTES(dim*sizeof(int));
+  return(bytes);
+}
 
-/* a truncated packet here just means 'stop working'; it's not an error */
+
+/* a truncated packet here just means 'stop working'; it's not an error.
+   A nonzero stagelimit decodes only the first stagelimit cascade
+   passes; the caller only asks for that when nothing else follows in
+   the packet, so the unread bits don't matter */
 static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
-		      ogg_int32_t **in,int ch,
+		      ogg_int32_t **in,int ch,int stagelimit,
 		      long (*decodepart)(codebook *, ogg_int32_t *, 
-					 oggpack_buffer *,int,int)){
+					 oggpack_buffer *,int,int,
+					 ogg_int32_t **)){
 
   long i,j,k,l,s;
   vorbis_look_residue0 *look=(vorbis_look_residue0 *)vl;
   vorbis_info_residue0 *info=look->info;
+  int stages=look->stages;
 
   /* move all this setup out later */
   int samples_per_partition=info->grouping;
@@ -222,15 +228,20 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
   int end=(info->end<max?info->end:max);
   int n=end-info->begin;
 
+  if(stagelimit>0 && stagelimit<stages)stages=stagelimit;
+
   if(n>0){
     int partvals=n/samples_per_partition;
     int partwords=(partvals+partitions_per_word-1)/partitions_per_word;
-    VAR_STACK(int **, partword, ch);
+    int ***partword=(int ***)_vorbis_block_alloc(vb,ch*sizeof(*partword));
+    /* room for decodepart's vector pointers at the smallest dim */
+    ogg_int32_t **work=(ogg_int32_t **)
+      _vorbis_block_alloc(vb,samples_per_partition*sizeof(*work));
     
     for(j=0;j<ch;j++)
       partword[j]=(int **)_vorbis_block_alloc(vb,partwords*sizeof(*partword[j]));
     
-    for(s=0;s<look->stages;s++){
+    for(s=0;s<stages;s++){
       
       /* each loop decodes on partition codeword containing 
 	 partitions_pre_word partitions */
@@ -253,7 +264,7 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
 	      codebook *stagebook=look->partbooks[partword[j][l][k]][s];
 	      if(stagebook){
 		if(decodepart(stagebook,in[j]+offset,&vb->opb,
-			      samples_per_partition,-8)==-1)goto eopbreak;
+			      samples_per_partition,-8,work)==-1)goto eopbreak;
 	      }
 	    }
 	  }
@@ -266,35 +277,36 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
 }
 
 int res0_inverse(vorbis_block *vb,vorbis_look_residue *vl,
-		 ogg_int32_t **in,int *nonzero,int ch){
+		 ogg_int32_t **in,int *nonzero,int ch,int stagelimit){
   int i,used=0;
   for(i=0;i<ch;i++)
     if(nonzero[i])
       in[used++]=in[i];
   if(used)
-    return(_01inverse(vb,vl,in,used,vorbis_book_decodevs_add));
+    return(_01inverse(vb,vl,in,used,stagelimit,vorbis_book_decodevs_add));
   else
     return(0);
 }
 
 int res1_inverse(vorbis_block *vb,vorbis_look_residue *vl,
-		 ogg_int32_t **in,int *nonzero,int ch){
+		 ogg_int32_t **in,int *nonzero,int ch,int stagelimit){
   int i,used=0;
   for(i=0;i<ch;i++)
     if(nonzero[i])
       in[used++]=in[i];
   if(used)
-    return(_01inverse(vb,vl,in,used,vorbis_book_decodev_add));
+    return(_01inverse(vb,vl,in,used,stagelimit,vorbis_book_decodev_add));
   else
     return(0);
 }
 
 /* duplicate code here as speed is somewhat more important */
 int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
-		 ogg_int32_t **in,int *nonzero,int ch){
+		 ogg_int32_t **in,int *nonzero,int ch,int stagelimit){
   long i,k,l,s;
   vorbis_look_residue0 *look=(vorbis_look_residue0 *)vl;
   vorbis_info_residue0 *info=look->info;
+  int stages=look->stages;
 
   /* move all this setup out later */
   int samples_per_partition=info->grouping;
@@ -303,6 +315,8 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
   int end=(info->end<max?info->end:max);
   int n=end-info->begin;
 
+  if(stagelimit>0 && stagelimit<stages)stages=stagelimit;
+
   if(n>0){
     
     int partvals=n/samples_per_partition;
@@ -315,7 +329,7 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
     
     samples_per_partition/=ch;
     
-    for(s=0;s<look->stages;s++){
+    for(s=0;s<stages;s++){
       for(i=0,l=0;i<partvals;l++){
 	
 	if(s==0){
@@ -348,26 +362,69 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
 }
 
 
+/* how many partition words _01inverse() or res2_inverse() reads per
+   vector, or -1 if the residue is outside the block; res2 interleaves
+   its channels into one vector */
+static long _res_partwords(vorbis_info *vi,vorbis_info_mode *vm,
+			   vorbis_info_residue *vr,int interleave){
+  vorbis_info_residue0 *info=(vorbis_info_residue0 *)vr;
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  long max=(ci->blocksizes[vm->blockflag]*interleave)>>1;
+  long end=(info->end<max?info->end:max);
+  long n=end-info->begin;
+  int dim=(ci->fullbooks?ci->fullbooks[info->groupbook].dim:
+	   ci->book_param[info->groupbook]->dim);
+
+  if(n>0){
+    long partvals=n/info->grouping;
+    return((partvals+dim-1)/dim);
+  }
+  return(-1);
+}
+
+/* what _01inverse() takes from the block for a submap of ch channels */
+static long res01_inverse_bytes(vorbis_info *vi,vorbis_info_mode *vm,
+				vorbis_info_residue *vr,int ch){
+  vorbis_info_residue0 *info=(vorbis_info_residue0 *)vr;
+  long partwords=_res_partwords(vi,vm,vr,1);
+
+  if(ch==0 || partwords<0)return(0);
+  return(ARENA_BYTES(ch*sizeof(int **))+
+	 ARENA_BYTES(info->grouping*sizeof(ogg_int32_t *))+
+	 ch*ARENA_BYTES(partwords*sizeof(int *)));
+}
+
+/* what res2_inverse() takes from the block */
+static long res2_inverse_bytes(vorbis_info *vi,vorbis_info_mode *vm,
+			       vorbis_info_residue *vr,int ch){
+  long partwords;
+
+  if(ch==0)return(0);
+  partwords=_res_partwords(vi,vm,vr,ch);
+  if(partwords<0)return(0);
+  return(ARENA_BYTES(partwords*sizeof(int *)));
+}
+
 vorbis_func_residue residue0_exportbundle={
   &res0_unpack,
   &res0_look,
-  &res0_free_info,
-  &res0_free_look,
-  &res0_inverse
+  &res0_look_bytes,
+  &res0_inverse,
+  &res01_inverse_bytes
 };
 
 vorbis_func_residue residue1_exportbundle={
   &res0_unpack,
   &res0_look,
-  &res0_free_info,
-  &res0_free_look,
-  &res1_inverse
+  &res0_look_bytes,
+  &res1_inverse,
+  &res01_inverse_bytes
 };
 
 vorbis_func_residue residue2_exportbundle={
   &res0_unpack,
   &res0_look,
-  &res0_free_info,
-  &res0_free_look,
-  &res2_inverse
+  &res0_look_bytes,
+  &res2_inverse,
+  &res2_inverse_bytes
 };
@@ -66,10 +66,12 @@ static ogg_int32_t _float32_unpack(long val,int *point){
 /* given a list of word lengths, generate a list of codewords.  Works
    for length ordered or unordered, always assigns the lowest valued
    codewords first.  Extended to handle unused entries (length 0) */
-ogg_uint32_t *_make_words(long *l,long n,long sparsecount){
+ogg_uint32_t *_make_words(long *l,long n,long sparsecount,
+			  const vorbis_allocator *a){
   long i,j,count=0;
   ogg_uint32_t marker[33];
-  ogg_uint32_t *r=(ogg_uint32_t *)_ogg_malloc((sparsecount?sparsecount:n)*sizeof(*r));
+  ogg_uint32_t *r=(ogg_uint32_t *)_vorbis_malloc(a,(sparsecount?sparsecount:n)*sizeof(*r));
+  if(!r)return(NULL);
   memset(marker,0,sizeof(marker));
 
   for(i=0;i<n;i++){
@@ -85,7 +87,7 @@ ogg_uint32_t *_make_words(long *l,long n,long sparsecount){
       /* update ourself */
       if(length<32 && (entry>>length)){
 	/* error condition; the lengths must specify an overpopulated tree */
-	_ogg_free(r);
+	_vorbis_free(a,r);
 	return(NULL);
       }
       r[count++]=entry;
@@ -129,7 +131,7 @@ ogg_uint32_t *_make_words(long *l,long n,long sparsecount){
   if(sparsecount != 1){
     for(i=1;i<33;i++)
       if(marker[i] & (0xffffffffUL>>(32-i))){
-       _ogg_free(r);
+       _vorbis_free(a,r);
        return(NULL);
       }
   }
@@ -191,15 +193,20 @@ long _book_maptype1_quantvals(const static_codebook *b){
    in in an explicit list.  Both value lists must be unpacked */
 
 ogg_int32_t *_book_unquantize(const static_codebook *b,int n,int *sparsemap,
-			      int *maxpoint){
+			      int *maxpoint,vorbis_arena *arena){
   long j,k,count=0;
   if(b->maptype==1 || b->maptype==2){
     int quantvals;
     int minpoint,delpoint;
     ogg_int32_t mindel=_float32_unpack(b->q_min,&minpoint);
     ogg_int32_t delta=_float32_unpack(b->q_delta,&delpoint);
-    ogg_int32_t *r=(ogg_int32_t *)_ogg_calloc(n*b->dim,sizeof(*r));
-    int *rp=(int *)_ogg_calloc(n*b->dim,sizeof(*rp));
+    ogg_int32_t *r=(ogg_int32_t *)_vorbis_arena_alloc(arena,n*b->dim*sizeof(*r));
+    int *rp=(int *)_vorbis_malloc(&arena->allocator,n*b->dim*sizeof(*rp));
+    if(!r || !rp){
+      _vorbis_free(&arena->allocator,rp);
+      return(NULL);
+    }
+    memset(rp,0,n*b->dim*sizeof(*rp));
 
     *maxpoint=minpoint;
 
@@ -287,30 +294,29 @@ ogg_int32_t *_book_unquantize(const static_codebook *b,int n,int *sparsemap,
       if(rp[j]<*maxpoint)
 	r[j]>>=*maxpoint-rp[j];
 	    
-    _ogg_free(rp);
+    _vorbis_free(&arena->allocator,rp);
     return(r);
   }
   return(NULL);
 }
 
-void vorbis_staticbook_destroy(static_codebook *b){
-  if(b->quantlist)_ogg_free(b->quantlist);
-  if(b->lengthlist)_ogg_free(b->lengthlist);
-  memset(b,0,sizeof(*b));
-  _ogg_free(b);
+/* what vorbis_staticbook_unpack() allocated for b */
+long vorbis_staticbook_bytes(const static_codebook *b){
+  long bytes=sizeof(*b);
+  if(b->lengthlist)bytes+=b->entries*sizeof(*b->lengthlist);
+  if(b->quantlist){
+    long quantvals=(b->maptype==1?_book_maptype1_quantvals(b):
+		    b->entries*b->dim);
+    bytes+=quantvals*sizeof(*b->quantlist);
+  }
+  return(bytes);
 }
 
-void vorbis_book_clear(codebook *b){
-  /* static book is not cleared; we're likely called on the lookup and
-     the static codebook belongs to the info struct */
-  if(b->valuelist)_ogg_free(b->valuelist);
-  if(b->codelist)_ogg_free(b->codelist);
-
-  if(b->dec_index)_ogg_free(b->dec_index);
-  if(b->dec_codelengths)_ogg_free(b->dec_codelengths);
-  if(b->dec_firsttable)_ogg_free(b->dec_firsttable);
-
+void vorbis_staticbook_destroy(static_codebook *b,const vorbis_allocator *a){
+  if(b->quantlist)_vorbis_free(a,b->quantlist);
+  if(b->lengthlist)_vorbis_free(a,b->lengthlist);
   memset(b,0,sizeof(*b));
+  _vorbis_free(a,b);
 }
 
 static ogg_uint32_t bitreverse(ogg_uint32_t x){
@@ -326,9 +332,35 @@ static int sort32a(const void *a,const void *b){
     (**(ogg_uint32_t **)a<**(ogg_uint32_t **)b);
 }
 
-/* decode codebook arrangement is more heavily optimized than encode */
-int vorbis_book_init_decode(codebook *c,const static_codebook *s){
+/* what vorbis_book_init_decode() will take from the arena for s */
+long vorbis_book_decode_bytes(const static_codebook *s){
+  long i,n=0,tabn,bytes=0;
+
+  for(i=0;i<s->entries;i++)
+    if(s->lengthlist[i]>0)
+      n++;
+
+  if(n>0){
+    bytes+=ARENA_BYTES(n*sizeof(ogg_uint32_t));   /* codelist */
+    if(s->maptype==1 || s->maptype==2)           /* valuelist */
+      bytes+=ARENA_BYTES(n*s->dim*sizeof(ogg_int32_t));
+    bytes+=ARENA_BYTES(n*sizeof(int));            /* dec_index */
+    bytes+=ARENA_BYTES(n*sizeof(char));           /* dec_codelengths */
+
+    tabn=_ilog(n)-4;
+    if(tabn<5)tabn=5;
+    if(tabn>8)tabn=8;
+    bytes+=ARENA_BYTES((1<<tabn)*sizeof(ogg_uint32_t));
+  }
+  return(bytes);
+}
+
+/* decode codebook arrangement is more heavily optimized than encode.
+   The decode tables come from the arena and go when it is cleared */
+int vorbis_book_init_decode(codebook *c,const static_codebook *s,
+			    vorbis_arena *arena){
   int i,j,n=0,tabn;
+  ogg_uint32_t **codep=NULL;
 
   memset(c,0,sizeof(*c));
   
@@ -352,11 +384,20 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
        Second, we reorder all vectors, including the entry index above,
        by sorted bitreversed codeword to allow treeless decode. */
     
-    /* perform sort */
-    ogg_uint32_t *codes=_make_words(s->lengthlist,s->entries,c->used_entries);
-    VAR_STACK(ogg_uint32_t *, codep, n);
-    
-    if(codes==NULL)goto err_out;
+    /* perform sort; the sort pointers and the reverse index are
+       scratch from the allocator, as the codewords are, rather than
+       from the stack, since n is only bounded by the setup header */
+    ogg_uint32_t *codes=_make_words(s->lengthlist,s->entries,c->used_entries,
+				    &arena->allocator);
+    int *sortindex;
+
+    codep=(ogg_uint32_t **)
+      _vorbis_malloc(&arena->allocator,n*(sizeof(*codep)+sizeof(int)));
+    if(codes==NULL || codep==NULL){
+      _vorbis_free(&arena->allocator,codes);
+      goto err_out;
+    }
+    sortindex=(int *)(codep+n);
 
     for(i=0;i<n;i++){
       codes[i]=bitreverse(codes[i]);
@@ -365,8 +406,11 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
 
     qsort(codep,n,sizeof(*codep),sort32a);
 
-  { VAR_STACK(int, sortindex, n);
-    c->codelist=(ogg_uint32_t *)_ogg_malloc(n*sizeof(*c->codelist));
+    c->codelist=(ogg_uint32_t *)_vorbis_arena_alloc(arena,n*sizeof(*c->codelist));
+    if(!c->codelist){
+      _vorbis_free(&arena->allocator,codes);
+      goto err_out;
+    }
     /* the index is a reverse index */
     for(i=0;i<n;i++){
       int position=codep[i]-codes;
@@ -375,28 +419,34 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
 
     for(i=0;i<n;i++)
       c->codelist[sortindex[i]]=codes[i];
-    _ogg_free(codes);
+    _vorbis_free(&arena->allocator,codes);
     
     
     
-    c->valuelist=_book_unquantize(s,n,sortindex,&c->binarypoint);
-    c->dec_index=(int *)_ogg_malloc(n*sizeof(*c->dec_index));
+    c->valuelist=_book_unquantize(s,n,sortindex,&c->binarypoint,arena);
+    if((s->maptype==1 || s->maptype==2) && !c->valuelist)goto err_out;
+    c->dec_index=(int *)_vorbis_arena_alloc(arena,n*sizeof(*c->dec_index));
+    if(!c->dec_index)goto err_out;
     
     for(n=0,i=0;i<s->entries;i++)
       if(s->lengthlist[i]>0)
 	c->dec_index[sortindex[n++]]=i;
     
-    c->dec_codelengths=(char *)_ogg_malloc(n*sizeof(*c->dec_codelengths));
+    c->dec_codelengths=(char *)_vorbis_arena_alloc(arena,n*sizeof(*c->dec_codelengths));
+    if(!c->dec_codelengths)goto err_out;
     for(n=0,i=0;i<s->entries;i++)
       if(s->lengthlist[i]>0)
 	c->dec_codelengths[sortindex[n++]]=s->lengthlist[i];
-  }
+    _vorbis_free(&arena->allocator,codep);
+    codep=NULL;
+    
     c->dec_firsttablen=_ilog(c->used_entries)-4; /* this is magic */
     if(c->dec_firsttablen<5)c->dec_firsttablen=5;
     if(c->dec_firsttablen>8)c->dec_firsttablen=8;
     
     tabn=1<<c->dec_firsttablen;
-    c->dec_firsttable=(ogg_uint32_t *)_ogg_calloc(tabn,sizeof(*c->dec_firsttable));
+    c->dec_firsttable=(ogg_uint32_t *)_vorbis_arena_alloc(arena,tabn*sizeof(*c->dec_firsttable));
+    if(!c->dec_firsttable)goto err_out;
     c->dec_maxlength=0;
     
     for(i=0;i<n;i++){
@@ -440,6 +490,8 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
 
   return(0);
  err_out:
-  vorbis_book_clear(c);
+  /* anything already taken from the arena goes when it is cleared */
+  _vorbis_free(&arena->allocator,codep);
+  memset(c,0,sizeof(*c));
   return(-1);
 }
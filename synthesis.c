@@ -71,11 +71,17 @@ static int _vorbis_synthesis1(vorbis_block *vb,ogg_packet *op,int decodep){
   vb->eofflag=op->e_o_s;
 
   if(decodep){
-    /* alloc pcm passback storage */
+    /* everything decoding the packet takes from the block is had up
+       front; once this succeeds the backends' allocations can't fail */
+    if(_vorbis_block_reserve(vb,b->blockbytes))return(OV_EFAULT);
+
+    /* pcm passback storage is the dsp state's free block buffer, so
+       that blockin can lap in place.  Only one block at a time may be
+       decoded ahead of vorbis_synthesis_blockin() */
     vb->pcmend=ci->blocksizes[vb->W];
     vb->pcm=(ogg_int32_t **)_vorbis_block_alloc(vb,sizeof(*vb->pcm)*vi->channels);
     for(i=0;i<vi->channels;i++)
-      vb->pcm[i]=(ogg_int32_t *)_vorbis_block_alloc(vb,vb->pcmend*sizeof(*vb->pcm[i]));
+      vb->pcm[i]=b->pcmbuf[!b->pcmcur][i]+b->pcmhead;
     
     /* unpack_header enforces range checking */
     type=ci->map_type[ci->mode_param[mode]->mapping];
@@ -100,15 +106,16 @@ int vorbis_synthesis_trackonly(vorbis_block *vb,ogg_packet *op){
   return _vorbis_synthesis1(vb,op,0);
 }
 
-long vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op){
-  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
-  oggpack_buffer       opb;
-  int                  mode;
- 
-  oggpack_readinit(&opb,op->packet,op->bytes);
+/* read an audio packet's type and mode, leaving opb just past the
+   mode number; returns the mode or a negative error */
+static int _packet_mode(codec_setup_info *ci,oggpack_buffer *opb,
+                        ogg_packet *op){
+  int mode;
+
+  oggpack_readinit(opb,op->packet,op->bytes);
 
   /* Check the packet type */
-  if(oggpack_read(&opb,1)!=0){
+  if(oggpack_read(opb,1)!=0){
     /* Oops.  This is not an audio data packet */
     return(OV_ENOTAUDIO);
   }
@@ -122,10 +129,93 @@ long vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op){
     }
 
     /* read our mode and pre/post windowsize */
-    mode=oggpack_read(&opb,modebits);
+    mode=oggpack_read(opb,modebits);
   }
   if(mode==-1 || !ci->mode_param[mode])return(OV_EBADPACKET);
+  return(mode);
+}
+
+long vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  oggpack_buffer       opb;
+  int                  mode=_packet_mode(ci,&opb,op);
+
+  if(mode<0)return(mode);
   return(ci->blocksizes[ci->mode_param[mode]->blockflag]);
 }
 
+/* size of the block following this packet's, as far as the packet
+   says: only long blocks carry the next window flag.  Returns 0 when
+   it isn't known */
+long vorbis_packet_nextblocksize(vorbis_info *vi,ogg_packet *op){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  oggpack_buffer       opb;
+  int                  mode=_packet_mode(ci,&opb,op),nW;
+
+  if(mode<0)return(mode);
+  if(!ci->mode_param[mode]->blockflag)return(0);
 
+  oggpack_adv(&opb,1);
+  nW=oggpack_read(&opb,1);
+  if(nW==-1)return(OV_EBADPACKET);
+  return(ci->blocksizes[nW]);
+}
+
+/* Decode at half the stream rate: only the lower half of each
+   spectrum is transformed, by an n/2 point IMDCT, and the result is
+   windowed/lapped at half size.  Must be set before
+   vorbis_synthesis_init(); granulepos bookkeeping is unaffected */
+int vorbis_synthesis_halfrate(vorbis_info *vi,int flag){
+  /* set / clear half-sample-rate mode */
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+
+  /* right now, our MDCT can't handle < 64 sample windows. */
+  if(ci->blocksizes[0]<=64 && flag)return -1;
+  ci->halfrate_flag=(flag?1:0);
+  return 0;
+}
+
+int vorbis_synthesis_halfrate_p(vorbis_info *vi){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  return ci->halfrate_flag;
+}
+
+/* Reduced complexity decode: apply at most 'stages' residue cascade
+   passes (0 restores full decode).  Later passes refine the coarse
+   first pass, so this trades accuracy for decode time; useful for
+   waveform previews and scrubbing.  May be changed at any time. */
+int vorbis_synthesis_preview(vorbis_info *vi,int stages){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+
+  if(stages<0)return OV_EINVAL;
+  ci->preview_stages=stages;
+  return 0;
+}
+
+int vorbis_synthesis_preview_p(vorbis_info *vi){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  return ci->preview_stages;
+}
+
+/* Decode with the 32 bit multiply kernels and 8 bit lookup tables of
+   a _LOW_ACCURACY_ build: faster and smaller, at some cost in output
+   quality.  Must be set before vorbis_synthesis_init().  A library
+   built with _LOW_ACCURACY_ cannot clear it. */
+int vorbis_synthesis_lowaccuracy(vorbis_info *vi,int flag){
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+
+#ifdef _LOW_ACCURACY_
+  if(!flag)return -1;
+#endif
+  ci->lowaccuracy_flag=(flag?1:0);
+  return 0;
+}
+
+int vorbis_synthesis_lowaccuracy_p(vorbis_info *vi){
+#ifdef _LOW_ACCURACY_
+  return 1;
+#else
+  codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
+  return ci->lowaccuracy_flag;
+#endif
+}
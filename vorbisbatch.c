@@ -0,0 +1,321 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis 'TREMOR' CODEC SOURCE CODE.   *
+ *                                                                  *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis 'TREMOR' SOURCE CODE IS (C) COPYRIGHT 1994-2014    *
+ * BY THE Xiph.Org FOUNDATION http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: decode many files at once on a pool of threads
+ last mod: $Id$
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+#include "ivorbiscodec.h"
+#include "ivorbisfile.h"
+#include "os.h"
+
+/* Each worker owns a contiguous run of the job array and takes jobs
+   from its front.  A worker that runs dry steals the back half of
+   another worker's run, so long files bunched together don't leave
+   the other threads idle.  Jobs never create jobs, so once a worker
+   finds nothing to take or steal it is done. */
+
+#define BATCH_BUFFER 8192
+
+typedef struct _batch_pool _batch_pool;
+
+/* A worker's decoders take their memory from the worker rather than
+   from malloc().  Freed blocks are kept on a spare list and handed
+   back out for requests of about the same size, so after its first
+   file a worker mostly reuses the setup, decoder and block storage
+   of the one before.  The list never holds more than the most the
+   worker has had in use at once, and is freed when the batch ends. */
+typedef union _batch_block{
+  struct{
+    union _batch_block *next;
+    size_t              bytes;
+  } h;
+  ogg_int64_t align;
+  double      align_d;
+  void       *align_p;
+} _batch_block;
+
+typedef struct {
+  _batch_pool     *pool;
+  int              id;
+  int              next;    /* this worker's run of jobs is [next,end) */
+  int              end;
+  OggVorbis_File   vf;      /* reused for each of this worker's jobs */
+  char             buffer[BATCH_BUFFER];
+
+  vorbis_allocator allocator;
+  _batch_block    *spare;
+  size_t           spare_bytes;
+  size_t           live_bytes;
+  size_t           peak_bytes;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t  lock;
+  pthread_t        thread;
+  int              started;
+#endif
+} _batch_worker;
+
+struct _batch_pool {
+  ov_batch_job    *jobs;
+  _batch_worker   *workers;
+  int              n;
+};
+
+/* wall clock time when jobs may run side by side; without pthreads
+   the jobs run one after another in the caller and clock()'s
+   processor time is the portable measure */
+static ogg_int64_t _batch_usec(void){
+#ifdef HAVE_PTHREAD
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return (ogg_int64_t)tv.tv_sec*1000000+tv.tv_usec;
+#else
+  return (ogg_int64_t)(clock()*(1000000./CLOCKS_PER_SEC));
+#endif
+}
+
+static void *_batch_alloc(void *ctx,size_t bytes){
+  _batch_worker *w=(_batch_worker *)ctx;
+  _batch_block **b,**best=NULL;
+
+  /* the smallest spare block that fits without wasting more than
+     the request itself */
+  for(b=&w->spare;*b;b=&(*b)->h.next)
+    if((*b)->h.bytes>=bytes && (*b)->h.bytes/2<=bytes &&
+       (!best || (*b)->h.bytes<(*best)->h.bytes))
+      best=b;
+
+  if(best){
+    _batch_block *v=*best;
+    *best=v->h.next;
+    w->spare_bytes-=v->h.bytes;
+    w->live_bytes+=v->h.bytes;
+    return v+1;
+  }else{
+    _batch_block *v=_ogg_malloc(sizeof(*v)+bytes);
+    if(!v)return NULL;
+    v->h.bytes=bytes;
+    w->live_bytes+=bytes;
+    if(w->peak_bytes<w->live_bytes)w->peak_bytes=w->live_bytes;
+    return v+1;
+  }
+}
+
+static void _batch_free(void *ctx,void *ptr){
+  _batch_worker *w=(_batch_worker *)ctx;
+  _batch_block *v;
+
+  if(!ptr)return;
+  v=(_batch_block *)ptr-1;
+  w->live_bytes-=v->h.bytes;
+  if(w->spare_bytes+v->h.bytes>w->peak_bytes){
+    _ogg_free(v);
+  }else{
+    v->h.next=w->spare;
+    w->spare=v;
+    w->spare_bytes+=v->h.bytes;
+  }
+}
+
+static void _batch_release(_batch_worker *w){
+  while(w->spare){
+    _batch_block *v=w->spare;
+    w->spare=v->h.next;
+    _ogg_free(v);
+  }
+  w->spare_bytes=0;
+}
+
+/* as vorbisfile.c's, for ov_open()'s callbacks */
+static int _batch_fseek(FILE *f,ogg_int64_t off,int whence){
+  if(f==NULL)return(-1);
+  return fseek(f,off,whence);
+}
+
+static void _batch_lock(_batch_worker *w){
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&w->lock);
+#endif
+}
+
+static void _batch_unlock(_batch_worker *w){
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&w->lock);
+#endif
+}
+
+static int _batch_take(_batch_worker *w){
+  int i=-1;
+  _batch_lock(w);
+  if(w->next<w->end)i=w->next++;
+  _batch_unlock(w);
+  return i;
+}
+
+static int _batch_steal(_batch_worker *w){
+  _batch_pool *p=w->pool;
+  int k;
+
+  for(k=1;k<p->n;k++){
+    _batch_worker *v=p->workers+(w->id+k)%p->n;
+    int begin=-1,end=-1;
+
+    _batch_lock(v);
+    if(v->next<v->end){
+      begin=v->next+(v->end-v->next)/2;
+      end=v->end;
+      v->end=begin;
+    }
+    _batch_unlock(v);
+
+    if(begin>=0){
+      /* run the first stolen job now, keep the rest */
+      _batch_lock(w);
+      w->next=begin+1;
+      w->end=end;
+      _batch_unlock(w);
+      return begin;
+    }
+  }
+  return -1;
+}
+
+static void _batch_run(_batch_worker *w,ov_batch_job *job){
+  OggVorbis_File *vf=&w->vf;
+  ogg_int64_t start=_batch_usec();
+  int ret,bs,channels;
+
+  job->samples=0;
+  job->bytes_in=0;
+
+  if(job->path){
+    ov_callbacks callbacks = {
+      (size_t (*)(void *, size_t, size_t, void *))  fread,
+      (int (*)(void *, ogg_int64_t, int))              _batch_fseek,
+      (int (*)(void *))                             fclose,
+      (long (*)(void *))                            ftell
+    };
+    FILE *f = fopen(job->path,"rb");
+
+    ret=-1;
+    if(f){
+      ret=ov_open_callbacks_alloc((void *)f,vf,NULL,0,callbacks,&w->allocator);
+      if(ret)fclose(f);
+    }
+  }else
+    ret=ov_open_callbacks_alloc(job->datasource,vf,NULL,0,job->callbacks,
+                                &w->allocator);
+
+  if(!ret){
+    ov_io_counters io;
+
+    while(1){
+      long bytes=ov_read(vf,w->buffer,BATCH_BUFFER,&bs);
+      if(bytes==0)break;
+      if(bytes==OV_HOLE)continue;
+      if(bytes<0){
+        ret=(int)bytes;
+        break;
+      }
+
+      /* a new link may change the channel count */
+      channels=ov_info(vf,-1)->channels;
+      job->samples+=bytes/(2*channels);
+      if(job->write_func &&
+         (ret=(job->write_func)(job->sink,w->buffer,bytes)))
+        break;
+    }
+
+    ov_io_stats(vf,&io);
+    job->bytes_in=io.read_bytes;
+    ov_clear(vf);
+  }
+
+  job->result=ret;
+  job->usec=_batch_usec()-start;
+}
+
+static void *_batch_worker_main(void *arg){
+  _batch_worker *w=(_batch_worker *)arg;
+  int i;
+
+  while((i=_batch_take(w))>=0 || (i=_batch_steal(w))>=0)
+    _batch_run(w,w->pool->jobs+i);
+  return NULL;
+}
+
+/* Decode jobs[0..n) on 'threads' threads (or in the caller if threads
+   aren't available) and return once all are done.  Returns the number
+   of jobs that failed. */
+int ov_batch_decode(ov_batch_job *jobs,int n,int threads){
+  _batch_pool pool;
+  int i,failed=0;
+
+  if(!jobs || n<0 || threads<1)return(OV_EINVAL);
+#ifndef HAVE_PTHREAD
+  threads=1;
+#endif
+  if(threads>n)threads=(n?n:1);
+
+  pool.jobs=jobs;
+  pool.n=threads;
+  pool.workers=_ogg_calloc(threads,sizeof(*pool.workers));
+  if(!pool.workers)return(OV_EFAULT);
+
+  for(i=0;i<threads;i++){
+    _batch_worker *w=pool.workers+i;
+    w->pool=&pool;
+    w->id=i;
+    w->next=(int)((ogg_int64_t)n*i/threads);
+    w->end=(int)((ogg_int64_t)n*(i+1)/threads);
+    w->allocator.alloc=_batch_alloc;
+    w->allocator.free=_batch_free;
+    w->allocator.ctx=w;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&w->lock,NULL);
+#endif
+  }
+
+#ifdef HAVE_PTHREAD
+  /* the caller is worker 0; a thread that can't be started leaves
+     its jobs to be stolen by the others */
+  for(i=1;i<threads;i++)
+    pool.workers[i].started=!pthread_create(&pool.workers[i].thread,NULL,
+                                            _batch_worker_main,pool.workers+i);
+  _batch_worker_main(pool.workers);
+  for(i=1;i<threads;i++)
+    if(pool.workers[i].started)pthread_join(pool.workers[i].thread,NULL);
+  for(i=0;i<threads;i++)
+    pthread_mutex_destroy(&pool.workers[i].lock);
+#else
+  _batch_worker_main(pool.workers);
+#endif
+
+  for(i=0;i<threads;i++)
+    _batch_release(pool.workers+i);
+  _ogg_free(pool.workers);
+  for(i=0;i<n;i++)
+    if(jobs[i].result)failed++;
+  return(failed);
+}
@@ -21,6 +21,14 @@
 #include <errno.h>
 #include <string.h>
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "ivorbiscodec.h"
 #include "ivorbisfile.h"
 
@@ -57,14 +65,25 @@
  * grokking near the end of the file */
 
 
-/* read a little more data from the file/pipe into the ogg_sync framer */
+/* read a little more data from the file/pipe into the ogg_sync framer.
+   Reads start small after a seek, where only a page or two is usually
+   wanted, and grow while the stream is read straight through */
 static long _get_data(OggVorbis_File *vf){
   errno=0;
+  /* in push mode the caller supplies data with ov_push_data() */
+  if(vf->push)return(vf->push==1?OV_NEEDDATA:0);
   if(!(vf->callbacks.read_func))return(-1);
   if(vf->datasource){
-    char *buffer=ogg_sync_buffer(&vf->oy,READSIZE);
-    long bytes=(vf->callbacks.read_func)(buffer,1,READSIZE,vf->datasource);
-    if(bytes>0)ogg_sync_wrote(&vf->oy,bytes);
+    long size=vf->read_size;
+    char *buffer=ogg_sync_buffer(&vf->oy,size);
+    long bytes=(vf->callbacks.read_func)(buffer,1,size,vf->datasource);
+    vf->io.read_calls++;
+    if(size<vf->read_max)
+      vf->read_size=(size*2<vf->read_max?size*2:vf->read_max);
+    if(bytes>0){
+      vf->io.read_bytes+=bytes;
+      ogg_sync_wrote(&vf->oy,bytes);
+    }
     if(bytes==0 && errno)return(-1);
     return(bytes);
   }else
@@ -76,10 +95,13 @@ static int _seek_helper(OggVorbis_File *vf,ogg_int64_t offset){
   if(vf->datasource){
     /* only seek if the file position isn't already there */
     if(vf->offset != offset){
-      if(!(vf->callbacks.seek_func)||
-         (vf->callbacks.seek_func)(vf->datasource, offset, SEEK_SET) == -1)
+      if(!(vf->callbacks.seek_func))
+        return OV_EREAD;
+      vf->io.seek_calls++;
+      if((vf->callbacks.seek_func)(vf->datasource, offset, SEEK_SET) == -1)
         return OV_EREAD;
       vf->offset=offset;
+      vf->read_size=vf->read_min;
       ogg_sync_reset(&vf->oy);
     }
   }else{
@@ -89,6 +111,86 @@ static int _seek_helper(OggVorbis_File *vf,ogg_int64_t offset){
   return 0;
 }
 
+/* Seek index helpers.  Entries are kept sorted by link and then
+   granulepos so the pages bracketing a seek target can be found by
+   bisection in memory rather than on the stream. */
+
+/* first entry not before (link,granulepos) */
+static long _index_find(OggVorbis_File *vf,int link,ogg_int64_t granulepos){
+  long lo=0,hi=vf->index_entries;
+  while(lo<hi){
+    long mid=(lo+hi)>>1;
+    ov_index_entry *e=vf->index+mid;
+    if(e->link<link || (e->link==link && e->granulepos<granulepos))
+      lo=mid+1;
+    else
+      hi=mid;
+  }
+  return lo;
+}
+
+static int _index_add(OggVorbis_File *vf,int link,ogg_int64_t granulepos,
+		      ogg_int64_t offset,ogg_int64_t next){
+  long i=_index_find(vf,link,granulepos);
+  ov_index_entry *e;
+
+  if(i<vf->index_entries && vf->index[i].link==link &&
+     vf->index[i].granulepos==granulepos)return 0; /* already known */
+
+  if(vf->index_entries==vf->index_alloc){
+    long alloc=(vf->index_alloc?vf->index_alloc*2:64);
+    e=_ogg_realloc(vf->index,alloc*sizeof(*e));
+    if(!e)return OV_EFAULT;
+    vf->index=e;
+    vf->index_alloc=alloc;
+  }
+  e=vf->index+i;
+  memmove(e+1,e,(vf->index_entries-i)*sizeof(*e));
+  e->link=link;
+  e->granulepos=granulepos;
+  e->offset=offset;
+  e->next=next;
+  vf->index_entries++;
+  return 0;
+}
+
+static void _index_clear(OggVorbis_File *vf){
+  if(vf->index)_ogg_free(vf->index);
+  vf->index=NULL;
+  vf->index_entries=vf->index_alloc=0;
+}
+
+/* remember the page _get_next_page just returned; pages read on a
+   seekable stream for any reason (open, decode, seeking) are free
+   fenceposts for later seeks.  The index stays sparse: a page is only
+   kept if no entry of its link lies within 1/INDEX_LEARNED of the
+   stream's length of it, so however much is read, learning adds at
+   most INDEX_LEARNED entries plus one per link.  The caller has
+   matched the page to 'link'.  A failed allocation only costs a
+   fencepost, so it's ignored. */
+#define INDEX_LEARNED 128
+
+static void _index_learn(OggVorbis_File *vf,int link,ogg_page *og){
+  ogg_int64_t granulepos=ogg_page_granulepos(og);
+  ogg_int64_t offset=vf->offset-og->header_len-og->body_len;
+  ogg_int64_t spacing=vf->end/INDEX_LEARNED;
+  long i;
+
+  /* header pages aren't seek targets.  While the links are still
+     being found, only the first link's data offset is known; the
+     later links' pages arrive from past their headers. */
+  if(!vf->seekable || granulepos==-1)return;
+  if(link<vf->links && offset<vf->dataoffsets[link])return;
+
+  /* within a link, granulepos order is stream order */
+  i=_index_find(vf,link,granulepos);
+  if(i>0 && vf->index[i-1].link==link &&
+     offset-vf->index[i-1].offset<spacing)return;
+  if(i<vf->index_entries && vf->index[i].link==link &&
+     vf->index[i].offset-offset<spacing)return;
+  _index_add(vf,link,granulepos,offset,vf->offset);
+}
+
 /* The read/seek functions track absolute position within the stream */
 
 /* from the head of the stream, get the next page.  boundary specifies
@@ -99,7 +201,8 @@ static int _seek_helper(OggVorbis_File *vf,ogg_int64_t offset){
               0) read no additional data; use cached only
               n) search for a new page beginning for n bytes
 
-   return:   <0) did not find a page (OV_FALSE, OV_EOF, OV_EREAD)
+   return:   <0) did not find a page (OV_FALSE, OV_EOF, OV_EREAD,
+                  OV_NEEDDATA)
               n) found a page at absolute offset n */
 
 static ogg_int64_t _get_next_page(OggVorbis_File *vf,ogg_page *og,
@@ -121,6 +224,7 @@ static ogg_int64_t _get_next_page(OggVorbis_File *vf,ogg_page *og,
         {
           long ret=_get_data(vf);
           if(ret==0)return(OV_EOF);
+          if(ret==OV_NEEDDATA)return(OV_NEEDDATA);
           if(ret<0)return(OV_EREAD);
         }
       }else{
@@ -214,16 +318,18 @@ static int _lookup_page_serialno(ogg_page *og, ogg_uint32_t *serialno_list, int
    spotted during the seek-back-and-read-forward, it will return the
    info of last page of the matching serial number instead of the very
    last page.  If no page of the specified serialno is seen, it will
-   return the info of last page and alter *serialno.  */
+   return the info of last page and alter *serialno.  If pageend isn't
+   NULL, it's set to the offset following the page returned. */
 static ogg_int64_t _get_prev_page_serial(OggVorbis_File *vf, ogg_int64_t begin,
                                          ogg_uint32_t *serial_list, int serial_n,
-                                         int *serialno, ogg_int64_t *granpos){
+                                         int *serialno, ogg_int64_t *granpos,
+                                         ogg_int64_t *pageend){
   ogg_page og;
   ogg_int64_t end=begin;
   ogg_int64_t ret;
 
-  ogg_int64_t prefoffset=-1;
-  ogg_int64_t offset=-1;
+  ogg_int64_t prefoffset=-1,prefend=-1;
+  ogg_int64_t offset=-1,offsetend=-1;
   ogg_int64_t ret_serialno=-1;
   ogg_int64_t ret_gran=-1;
 
@@ -244,9 +350,11 @@ static ogg_int64_t _get_prev_page_serial(OggVorbis_File *vf, ogg_int64_t begin,
         ret_serialno=ogg_page_serialno(&og);
         ret_gran=ogg_page_granulepos(&og);
         offset=ret;
+        offsetend=vf->offset;
 
         if((ogg_uint32_t)ret_serialno == *serialno){
           prefoffset=ret;
+          prefend=vf->offset;
           *granpos=ret_gran;
         }
 
@@ -262,19 +370,33 @@ static ogg_int64_t _get_prev_page_serial(OggVorbis_File *vf, ogg_int64_t begin,
   }
 
   /* we're not interested in the page... just the serialno and granpos. */
-  if(prefoffset>=0)return(prefoffset);
+  if(prefoffset>=0){
+    if(pageend)*pageend=prefend;
+    return(prefoffset);
+  }
 
   *serialno = ret_serialno;
   *granpos = ret_gran;
+  if(pageend)*pageend=offsetend;
   return(offset);
 
 }
 
+/* a link's comments start out with the limits the file was opened
+   with; see ov_open_callbacks_limit() */
+static void _comment_init(OggVorbis_File *vf,vorbis_comment *vc){
+  vorbis_comment_init(vc);
+  vc->max_length=vf->comment_max;
+  vc->filter=vf->comment_filter;
+  vc->filter_data=vf->comment_filter_data;
+}
+
 /* uses the local ogg_stream storage in vf; this is important for
-   non-streaming input sources */
+   non-streaming input sources.  Reads the first 'headers' of the
+   three vorbis headers */
 static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
                           ogg_uint32_t **serialno_list, int *serialno_n,
-                          ogg_page *og_ptr){
+                          ogg_page *og_ptr,int headers){
   ogg_page og;
   ogg_packet op;
   int i,ret;
@@ -287,8 +409,8 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
     og_ptr=&og;
   }
 
-  vorbis_info_init(vi);
-  vorbis_comment_init(vc);
+  vorbis_info_init_alloc(vi,&vf->allocator);
+  _comment_init(vf,vc);
   vf->ready_state=OPENED;
 
   /* extract the serialnos of all BOS pages + the first set of vorbis
@@ -353,10 +475,10 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
 
   while(1){
 
-    i=0;
-    while(i<2){ /* get a page loop */
+    i=1;
+    while(i<headers){ /* get a page loop */
 
-      while(i<2){ /* get a packet loop */
+      while(i<headers){ /* get a packet loop */
 
         int result=ogg_stream_packetout(&vf->os,&op);
         if(result==0)break;
@@ -371,7 +493,7 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
         i++;
       }
 
-      while(i<2){
+      while(i<headers){
         if(_get_next_page(vf,og_ptr,CHUNKSIZE)<0){
           ret=OV_EBADHEADER;
           goto bail_header;
@@ -408,11 +530,63 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
   return ret;
 }
 
+/* push mode counterpart of _fetch_headers: the link's header pages are
+   taken one at a time as they arrive.  Until the first vorbis BOS page
+   turns up the previous link's setup is kept, so the decode options
+   can be carried over.
+
+   return: <0) error
+            0) needs another page
+            1) all three headers are in */
+static int _push_headers(OggVorbis_File *vf,ogg_page *og){
+  ogg_packet op;
+  int ret;
+
+  if(vf->push_headers==0){
+    int halfrate=0,preview=0,lowaccuracy=0;
+
+    if(!ogg_page_bos(og))return 0;
+    ogg_stream_reset_serialno(&vf->os,ogg_page_serialno(og));
+    ogg_stream_pagein(&vf->os,og);
+    if(ogg_stream_packetout(&vf->os,&op)<=0 || !vorbis_synthesis_idheader(&op))
+      return 0; /* some other stream */
+
+    if(vf->vi->codec_setup){
+      halfrate=vorbis_synthesis_halfrate_p(vf->vi);
+      preview=vorbis_synthesis_preview_p(vf->vi);
+      lowaccuracy=vorbis_synthesis_lowaccuracy_p(vf->vi);
+    }
+    vorbis_info_clear(vf->vi);
+    vorbis_comment_clear(vf->vc);
+    vorbis_info_init_alloc(vf->vi,&vf->allocator);
+    _comment_init(vf,vf->vc);
+    if(vorbis_synthesis_headerin(vf->vi,vf->vc,&op))return(OV_EBADHEADER);
+    if(halfrate)vorbis_synthesis_halfrate(vf->vi,1);
+    vorbis_synthesis_preview(vf->vi,preview);
+    if(lowaccuracy)vorbis_synthesis_lowaccuracy(vf->vi,1);
+    vf->push_headers=1;
+  }else{
+    if(ogg_page_serialno(og)!=vf->os.serialno)return 0;
+    ogg_stream_pagein(&vf->os,og);
+  }
+
+  while(vf->push_headers<3 && (ret=ogg_stream_packetout(&vf->os,&op))){
+    if(ret<0)return(OV_EBADHEADER);
+    if((ret=vorbis_synthesis_headerin(vf->vi,vf->vc,&op)))return(ret);
+    vf->push_headers++;
+  }
+  if(vf->push_headers<3)return 0;
+
+  vf->push_headers=0;
+  return 1;
+}
+
 /* Starting from current cursor position, get initial PCM offset of
    next page.  Consumes the page in the process without decoding
    audio, however this is only called during stream parsing upon
    seekable open. */
-static ogg_int64_t _initial_pcmoffset(OggVorbis_File *vf, vorbis_info *vi){
+static ogg_int64_t _initial_pcmoffset(OggVorbis_File *vf, vorbis_info *vi,
+                                      int link){
   ogg_page    og;
   ogg_int64_t accumulated=0;
   long        lastblock=-1;
@@ -441,6 +615,7 @@ static ogg_int64_t _initial_pcmoffset(OggVorbis_File *vf, vorbis_info *vi){
     }
 
     if(ogg_page_granulepos(&og)!=-1){
+      _index_learn(vf,link,&og);
       /* pcm offset of last packet on the first audio page */
       accumulated= ogg_page_granulepos(&og)-accumulated;
       break;
@@ -457,11 +632,14 @@ static ogg_int64_t _initial_pcmoffset(OggVorbis_File *vf, vorbis_info *vi){
 /* finds each bitstream link one at a time using a bisection search
    (has to begin by knowing the offset of the lb's initial page).
    Recurses for each link so it can alloc the link storage after
-   finding them all, then unroll and fill the cache at the same time */
+   finding them all, then unroll and fill the cache at the same time.
+   'end' is the offset of the last page in the file and 'endnext' the
+   offset following it. */
 static int _bisect_forward_serialno(OggVorbis_File *vf,
                                     ogg_int64_t begin,
                                     ogg_int64_t searched,
                                     ogg_int64_t end,
+                                    ogg_int64_t endnext,
                                     ogg_int64_t endgran,
                                     int endserial,
                                     ogg_uint32_t *currentno_list,
@@ -472,6 +650,7 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
   ogg_int64_t endsearched=end;
   ogg_int64_t next=end;
   ogg_int64_t searchgran=-1;
+  ogg_int64_t pageend=-1;
   ogg_page og;
   ogg_int64_t ret,last;
   int serialno = vf->os.serialno;
@@ -490,9 +669,10 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
        find the last vorbis page belonging to the first vorbis stream
        for this link. */
     searched = end;
+    pageend = endnext;
     while(endserial != serialno){
       endserial = serialno;
-      searched=_get_prev_page_serial(vf,searched,currentno_list,currentnos,&endserial,&endgran);
+      searched=_get_prev_page_serial(vf,searched,currentno_list,currentnos,&endserial,&endgran,&pageend);
     }
 
     vf->links=m+1;
@@ -511,6 +691,9 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
     vf->offsets[m]=begin;
     vf->pcmlengths[m*2+1]=(endgran<0?0:endgran);
 
+    if(endgran>=0 && pageend>searched)
+      _index_add(vf,m,endgran,searched,pageend);
+
   }else{
 
     /* last page is not in the starting stream's serial number list,
@@ -543,6 +726,8 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
         endsearched=bisect;
         if(last>=0)next=last;
       }else{
+        if(ogg_page_serialno(&og)==serialno)
+          _index_learn(vf,m,&og);
         searched=vf->offset;
       }
     }
@@ -552,26 +737,32 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
     searched = next;
     while(testserial != serialno){
       testserial = serialno;
-      searched = _get_prev_page_serial(vf,searched,currentno_list,currentnos,&testserial,&searchgran);
+      searched = _get_prev_page_serial(vf,searched,currentno_list,currentnos,&testserial,&searchgran,&pageend);
     }
 
     ret=_seek_helper(vf,next);
     if(ret)return(ret);
 
-    ret=_fetch_headers(vf,&vi,&vc,&next_serialno_list,&next_serialnos,NULL);
-    if(ret)return(ret);
+    ret=_fetch_headers(vf,&vi,&vc,&next_serialno_list,&next_serialnos,NULL,3);
+    if(ret){
+      if(next_serialno_list)_ogg_free(next_serialno_list);
+      return(ret);
+    }
     serialno = vf->os.serialno;
     dataoffset = vf->offset;
 
     /* this will consume a page, however the next bisection always
        starts with a raw seek */
-    pcmoffset = _initial_pcmoffset(vf,&vi);
+    pcmoffset = _initial_pcmoffset(vf,&vi,m+1);
 
-    ret=_bisect_forward_serialno(vf,next,vf->offset,end,endgran,endserial,
+    ret=_bisect_forward_serialno(vf,next,vf->offset,end,endnext,endgran,endserial,
                                  next_serialno_list,next_serialnos,m+1);
-    if(ret)return(ret);
-
     if(next_serialno_list)_ogg_free(next_serialno_list);
+    if(ret){
+      vorbis_info_clear(&vi);
+      vorbis_comment_clear(&vc);
+      return(ret);
+    }
 
     vf->offsets[m+1]=next;
     vf->serialnos[m+1]=serialno;
@@ -582,6 +773,8 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
 
     vf->pcmlengths[m*2+1]=searchgran;
     vf->pcmlengths[m*2+2]=pcmoffset;
+    if(searchgran>=0 && pageend>searched)
+      _index_add(vf,m,searchgran,searched,pageend);
     vf->pcmlengths[m*2+3]-=pcmoffset;
     if(vf->pcmlengths[m*2+3]<0)vf->pcmlengths[m*2+3]=0;
 
@@ -599,15 +792,41 @@ static int _make_decode_ready(OggVorbis_File *vf){
     if(vorbis_synthesis_init(&vf->vd,vf->vi))
       return OV_EBADLINK;
   }
-  vorbis_block_init(&vf->vd,&vf->vb);
+  if(vorbis_block_init(&vf->vd,&vf->vb)){
+    vorbis_block_clear(&vf->vb);
+    vorbis_dsp_clear(&vf->vd);
+    return OV_EFAULT;
+  }
   vf->ready_state=INITSET;
   vf->bittrack=0;
   vf->samptrack=0;
   return 0;
 }
 
-static int _open_seekable2(OggVorbis_File *vf){
-  ogg_int64_t dataoffset=vf->dataoffsets[0],end,endgran=-1;
+/* set up the link storage of a partial open: the first link's serial
+   number list, held for the second stage of a seekable open; this saves
+   having to seek/reread the first link's serialnumber data then. */
+static void _partopen_links(OggVorbis_File *vf,ogg_uint32_t *serialno_list,
+                            int serialno_list_size){
+  if(vf->serialnos)_ogg_free(vf->serialnos);
+  if(vf->offsets)_ogg_free(vf->offsets);
+  if(vf->dataoffsets)_ogg_free(vf->dataoffsets);
+
+  vf->serialnos=_ogg_calloc(serialno_list_size+2,sizeof(*vf->serialnos));
+  vf->serialnos[0]=vf->os.serialno;
+  vf->serialnos[1]=serialno_list_size;
+  memcpy(vf->serialnos+2,serialno_list,serialno_list_size*sizeof(*vf->serialnos));
+
+  vf->offsets=_ogg_calloc(1,sizeof(*vf->offsets));
+  vf->dataoffsets=_ogg_calloc(1,sizeof(*vf->dataoffsets));
+  vf->offsets[0]=0;
+  vf->dataoffsets[0]=vf->offset;
+}
+
+/* find every link of a seekable stream, starting from the partial
+   open state; leaves the read position wherever the search ended */
+static int _open_links(OggVorbis_File *vf){
+  ogg_int64_t dataoffset=vf->dataoffsets[0],end,endnext=-1,endgran=-1;
   int endserial=vf->os.serialno;
   int serialno=vf->os.serialno;
 
@@ -615,10 +834,11 @@ static int _open_seekable2(OggVorbis_File *vf){
      storage in vf */
 
   /* fetch initial PCM offset */
-  ogg_int64_t pcmoffset = _initial_pcmoffset(vf,vf->vi);
+  ogg_int64_t pcmoffset = _initial_pcmoffset(vf,vf->vi,0);
 
   /* we can seek, so set out learning all about this file */
   if(vf->callbacks.seek_func && vf->callbacks.tell_func){
+    vf->io.seek_calls++;
     (vf->callbacks.seek_func)(vf->datasource,0,SEEK_END);
     vf->offset=vf->end=(vf->callbacks.tell_func)(vf->datasource);
   }else{
@@ -631,11 +851,11 @@ static int _open_seekable2(OggVorbis_File *vf){
   /* Get the offset of the last page of the physical bitstream, or, if
      we're lucky the last vorbis page of this link as most OggVorbis
      files will contain a single logical bitstream */
-  end=_get_prev_page_serial(vf,vf->end,vf->serialnos+2,vf->serialnos[1],&endserial,&endgran);
+  end=_get_prev_page_serial(vf,vf->end,vf->serialnos+2,vf->serialnos[1],&endserial,&endgran,&endnext);
   if(end<0)return(end);
 
   /* now determine bitstream structure recursively */
-  if(_bisect_forward_serialno(vf,0,dataoffset,end,endgran,endserial,
+  if(_bisect_forward_serialno(vf,0,dataoffset,end,endnext,endgran,endserial,
                               vf->serialnos+2,vf->serialnos[1],0)<0)return(OV_EREAD);
 
   vf->offsets[0]=0;
@@ -645,7 +865,13 @@ static int _open_seekable2(OggVorbis_File *vf){
   vf->pcmlengths[1]-=pcmoffset;
   if(vf->pcmlengths[1]<0)vf->pcmlengths[1]=0;
 
-  return(ov_raw_seek(vf,dataoffset));
+  return(0);
+}
+
+static int _open_seekable2(OggVorbis_File *vf){
+  int ret=_open_links(vf);
+  if(ret)return(ret);
+  return(ov_raw_seek(vf,vf->dataoffsets[0]));
 }
 
 /* clear out the current logical bitstream decoder */
@@ -655,6 +881,109 @@ static void _decode_clear(OggVorbis_File *vf){
   vf->ready_state=OPENED;
 }
 
+/* Finish a fast open (see ov_open_callbacks_fast()).  Until now the
+   first link has been read as an unseekable stream (crossing into the
+   next link lands here first, so it is always the first); find all
+   the links as _open_seekable2 would have, without disturbing decode:
+   the link's stream and decoder state are set aside and put back.
+   If the links can't be found the file stays unseekable. */
+static void _ov_discover(OggVorbis_File *vf){
+  vorbis_info *vi=vf->vi;
+  vorbis_comment *vc=vf->vc;
+  ogg_stream_state os=vf->os;
+  ogg_int64_t offset=vf->offset;
+  int ready_state=vf->ready_state;
+  int halfrate=0,preview=0,lowaccuracy=0;
+  ogg_uint32_t *serialno_list=NULL;
+  int serialno_list_size=0;
+  int i,ret;
+
+  if(!vf->deferred)return;
+  vf->deferred=0;
+
+  if(ready_state>=STREAMSET){
+    halfrate=vorbis_synthesis_halfrate_p(vi);
+    preview=vorbis_synthesis_preview_p(vi);
+    lowaccuracy=vorbis_synthesis_lowaccuracy_p(vi);
+  }
+
+  /* reread the first link's headers into fresh storage */
+  vf->seekable=1;
+  vf->links=1;
+  vf->vi=_ogg_calloc(1,sizeof(*vf->vi));
+  vf->vc=_ogg_calloc(1,sizeof(*vf->vc));
+  ogg_stream_init(&vf->os,-1);
+
+  ret=_seek_helper(vf,0);
+  if(!ret)
+    ret=_fetch_headers(vf,vf->vi,vf->vc,&serialno_list,&serialno_list_size,NULL,3);
+  if(!ret){
+    _partopen_links(vf,serialno_list,serialno_list_size);
+    ret=_open_links(vf);
+    if(ret){
+      vorbis_info_clear(vf->vi);
+      vorbis_comment_clear(vf->vc);
+    }
+  }
+  if(serialno_list)_ogg_free(serialno_list);
+
+  ogg_stream_clear(&vf->os);
+  vf->os=os;
+  vf->ready_state=ready_state;
+
+  if(ret){
+    _ogg_free(vf->vi);
+    _ogg_free(vf->vc);
+    vf->vi=vi;
+    vf->vc=vc;
+    vf->links=1;
+    vf->seekable=0;
+    _index_clear(vf);
+  }else{
+    /* the decoder keeps using the setup it was started with */
+    if(ready_state>=STREAMSET){
+      vorbis_info_clear(vf->vi);
+      vorbis_comment_clear(vf->vc);
+      vf->vi[0]=*vi;
+      vf->vc[0]=*vc;
+      if(ready_state==INITSET)vf->vd.vi=vf->vi;
+    }else{
+      vorbis_info_clear(vi);
+      vorbis_comment_clear(vc);
+    }
+    _ogg_free(vi);
+    _ogg_free(vc);
+
+    for(i=0;i<vf->links;i++){
+      if(halfrate)vorbis_synthesis_halfrate(vf->vi+i,1);
+      vorbis_synthesis_preview(vf->vi+i,preview);
+      if(lowaccuracy)vorbis_synthesis_lowaccuracy(vf->vi+i,1);
+    }
+  }
+
+  /* pick up reading where the stream left off */
+  _seek_helper(vf,offset);
+}
+
+/* In halfrate mode each returned sample stands for two in the stream.
+   pcm_offset and pcmlengths stay in stream (granulepos) units
+   throughout; only the sample counts passed across the API are
+   scaled. */
+static int _halfrate_shift(OggVorbis_File *vf){
+  if(vf->vi && vf->vi->codec_setup)
+    return vorbis_synthesis_halfrate_p(vf->vi);
+  return 0;
+}
+
+/* total length in stream units of all links; seekable streams only */
+static ogg_int64_t _pcm_total(OggVorbis_File *vf){
+  ogg_int64_t acc=0;
+  int i;
+  for(i=0;i<vf->links;i++)
+    acc+=vf->pcmlengths[i*2+1];
+  return(acc);
+}
+
 /* fetch and process a packet.  Handles the case where we're at a
    bitstream boundary and dumps the decoding machine.  If the decoding
    machine is unloaded, it loads it.  It also keeps pcm_offset up to
@@ -671,6 +1000,9 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
                                      int readp,
                                      int spanp){
   ogg_page og;
+  int halfrate=0;
+  int preview=0;
+  int lowaccuracy=0;
 
   /* handle one packet.  Try to fetch it from current stream state */
   /* extract packets from page */
@@ -711,7 +1043,8 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
               if(oldsamples)return(OV_EFAULT);
 
               vorbis_synthesis_blockin(&vf->vd,&vf->vb);
-              vf->samptrack+=vorbis_synthesis_pcmout(&vf->vd,NULL);
+              vf->samptrack+=(ogg_int64_t)vorbis_synthesis_pcmout(&vf->vd,NULL)
+                <<_halfrate_shift(vf);
               vf->bittrack+=op_ptr->bytes*8;
             }
 
@@ -742,7 +1075,7 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
 
               samples=vorbis_synthesis_pcmout(&vf->vd,NULL);
 
-              granulepos-=samples;
+              granulepos-=(ogg_int64_t)samples<<_halfrate_shift(vf);
               for(i=0;i<link;i++)
                 granulepos+=vf->pcmlengths[i*2+1];
               vf->pcm_offset=granulepos;
@@ -767,6 +1100,7 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
 
         if(!readp)return(0);
         if((ret=_get_next_page(vf,&og,-1))<0){
+          if(ret==OV_NEEDDATA)return(OV_NEEDDATA);
           return(OV_EOF); /* eof. leave unitialized */
         }
 
@@ -786,9 +1120,24 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
               if(!spanp)
                 return(OV_EOF);
 
+              /* after a fast open, find the links before leaving the
+                 first; that reuses the read buffer, so reread the page */
+              if(vf->deferred){
+                ogg_int64_t bos=vf->offset-og.header_len-og.body_len;
+                vf->bittrack-=og.header_len*8;
+                _ov_discover(vf);
+                if(_seek_helper(vf,bos))return(OV_EREAD);
+                continue;
+              }
+
               _decode_clear(vf);
 
-              if(!vf->seekable){
+              /* push mode keeps the old setup until the new link's
+                 id header arrives; see _push_headers */
+              if(!vf->seekable && !vf->push){
+                halfrate=vorbis_synthesis_halfrate_p(vf->vi);
+                preview=vorbis_synthesis_preview_p(vf->vi);
+                lowaccuracy=vorbis_synthesis_lowaccuracy_p(vf->vi);
                 vorbis_info_clear(vf->vi);
                 vorbis_comment_clear(vf->vc);
               }
@@ -839,12 +1188,28 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
           ogg_stream_reset_serialno(&vf->os,vf->current_serialno);
           vf->ready_state=STREAMSET;
 
+        }else if(vf->push){
+          /* headers arrive a page at a time; the page has been
+             consumed either way */
+          int ret=_push_headers(vf,&og);
+          if(ret<0)return(ret);
+          if(ret){
+            vf->current_serialno=vf->os.serialno;
+            vf->current_link++;
+            vf->ready_state=STREAMSET;
+          }
+          continue;
+
         }else{
           /* we're streaming */
           /* fetch the three header packets, build the info struct */
 
-          int ret=_fetch_headers(vf,vf->vi,vf->vc,NULL,NULL,&og);
+          int ret=_fetch_headers(vf,vf->vi,vf->vc,NULL,NULL,&og,3);
           if(ret)return(ret);
+          /* carry decode options across the new link */
+          if(halfrate)vorbis_synthesis_halfrate(vf->vi,1);
+          vorbis_synthesis_preview(vf->vi,preview);
+          if(lowaccuracy)vorbis_synthesis_lowaccuracy(vf->vi,1);
           vf->current_serialno=vf->os.serialno;
           vf->current_link++;
           link=0;
@@ -854,6 +1219,8 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
 
     /* the buffered page is the data we want, and we're ready for it;
        add it to the stream state */
+    if(vf->seekable && ogg_page_serialno(&og)==vf->current_serialno)
+      _index_learn(vf,vf->current_link,&og);
     ogg_stream_pagein(&vf->os,&og);
 
   }
@@ -866,6 +1233,8 @@ static int _fseek64_wrap(FILE *f,ogg_int64_t off,int whence){
   return fseek(f,off,whence);
 }
 
+/* vf is cleared by the caller, which may then set the comment limits
+   and allocator before anything is read */
 static int _ov_open1(void *f,OggVorbis_File *vf,const char *initial,
                      long ibytes, ov_callbacks callbacks){
   int offsettest=((f && callbacks.seek_func)?callbacks.seek_func(f,0,SEEK_CUR):-1);
@@ -873,9 +1242,11 @@ static int _ov_open1(void *f,OggVorbis_File *vf,const char *initial,
   int serialno_list_size=0;
   int ret;
 
-  memset(vf,0,sizeof(*vf));
   vf->datasource=f;
   vf->callbacks = callbacks;
+  vf->read_min=vf->read_size=READSIZE;
+  vf->read_max=READSIZE_MAX;
+  if(f && callbacks.seek_func)vf->io.seek_calls++; /* offsettest */
 
   /* init the framing state */
   ogg_sync_init(&vf->oy);
@@ -902,23 +1273,12 @@ static int _ov_open1(void *f,OggVorbis_File *vf,const char *initial,
 
   /* Fetch all BOS pages, store the vorbis header and all seen serial
      numbers, load subsequent vorbis setup headers */
-  if((ret=_fetch_headers(vf,vf->vi,vf->vc,&serialno_list,&serialno_list_size,NULL))<0){
+  if((ret=_fetch_headers(vf,vf->vi,vf->vc,&serialno_list,&serialno_list_size,NULL,3))<0){
     vf->datasource=NULL;
     ov_clear(vf);
   }else{
-    /* serial number list for first link needs to be held somewhere
-       for second stage of seekable stream open; this saves having to
-       seek/reread first link's serialnumber data then. */
-    vf->serialnos=_ogg_calloc(serialno_list_size+2,sizeof(*vf->serialnos));
-    vf->serialnos[0]=vf->current_serialno=vf->os.serialno;
-    vf->serialnos[1]=serialno_list_size;
-    memcpy(vf->serialnos+2,serialno_list,serialno_list_size*sizeof(*vf->serialnos));
-
-    vf->offsets=_ogg_calloc(1,sizeof(*vf->offsets));
-    vf->dataoffsets=_ogg_calloc(1,sizeof(*vf->dataoffsets));
-    vf->offsets[0]=0;
-    vf->dataoffsets[0]=vf->offset;
-
+    _partopen_links(vf,serialno_list,serialno_list_size);
+    vf->current_serialno=vf->os.serialno;
     vf->ready_state=PARTOPEN;
   }
   if(serialno_list)_ogg_free(serialno_list);
@@ -962,6 +1322,7 @@ int ov_clear(OggVorbis_File *vf){
     if(vf->pcmlengths)_ogg_free(vf->pcmlengths);
     if(vf->serialnos)_ogg_free(vf->serialnos);
     if(vf->offsets)_ogg_free(vf->offsets);
+    _index_clear(vf);
     ogg_sync_clear(&vf->oy);
     if(vf->datasource && vf->callbacks.close_func)
       (vf->callbacks.close_func)(vf->datasource);
@@ -983,8 +1344,99 @@ int ov_clear(OggVorbis_File *vf){
 
 int ov_open_callbacks(void *f,OggVorbis_File *vf,
     const char *initial,long ibytes,ov_callbacks callbacks){
-  int ret=_ov_open1(f,vf,initial,ibytes,callbacks);
+  int ret;
+  memset(vf,0,sizeof(*vf));
+  ret=_ov_open1(f,vf,initial,ibytes,callbacks);
+  if(ret)return ret;
+  return _ov_open2(vf);
+}
+
+/* as ov_open_callbacks, but comment fields longer than max_length
+   bytes, or that the filter turns down, aren't copied into the
+   comments; ov_comment_fetch() reads them when they're wanted */
+int ov_open_callbacks_limit(void *f,OggVorbis_File *vf,
+    const char *initial,long ibytes,ov_callbacks callbacks,
+    int max_length,vorbis_comment_filter filter,void *filter_data){
+  int ret;
+  memset(vf,0,sizeof(*vf));
+  if(max_length<0)return(OV_EINVAL);
+  vf->comment_max=max_length;
+  vf->comment_filter=filter;
+  vf->comment_filter_data=filter_data;
+  ret=_ov_open1(f,vf,initial,ibytes,callbacks);
+  if(ret)return ret;
+  return _ov_open2(vf);
+}
+
+/* as ov_open_callbacks, but the decoder's setup, codebooks, lookups
+   and buffers come from allocator.  The allocator is copied, and its
+   ctx must stay valid until ov_clear(). */
+int ov_open_callbacks_alloc(void *f,OggVorbis_File *vf,
+    const char *initial,long ibytes,ov_callbacks callbacks,
+    const vorbis_allocator *allocator){
+  int ret;
+  memset(vf,0,sizeof(*vf));
+  if(!allocator || !allocator->alloc || !allocator->free)return(OV_EINVAL);
+  vf->allocator=*allocator;
+  ret=_ov_open1(f,vf,initial,ibytes,callbacks);
+  if(ret)return ret;
+  return _ov_open2(vf);
+}
+
+/* set up vf to decode data handed over with ov_push_data() rather than
+   pulled through callbacks.  Nothing is read yet; the read functions
+   return OV_NEEDDATA whenever they run out of data, headers
+   included, and can be called again once more has been pushed. */
+int ov_push_open(OggVorbis_File *vf){
+  memset(vf,0,sizeof(*vf));
+  vf->push=1;
+  vf->read_min=vf->read_size=READSIZE;
+  vf->read_max=READSIZE_MAX;
+
+  ogg_sync_init(&vf->oy);
+  vf->links=1;
+  vf->vi=_ogg_calloc(vf->links,sizeof(*vf->vi));
+  vf->vc=_ogg_calloc(vf->links,sizeof(*vf->vc));
+  ogg_stream_init(&vf->os,-1);
+
+  vf->current_link=-1; /* the first link's headers make this 0 */
+  vf->ready_state=OPENED;
+  return 0;
+}
+
+/* append bytes to the stream; a NULL buffer marks the end of it */
+int ov_push_data(OggVorbis_File *vf,const void *buffer,long bytes){
+  if(!vf->push || vf->ready_state<OPENED)return(OV_EINVAL);
+  if(!buffer){
+    vf->push=2;
+    return 0;
+  }
+  if(vf->push!=1 || bytes<0)return(OV_EINVAL);
+  if(bytes){
+    char *b=ogg_sync_buffer(&vf->oy,bytes);
+    if(!b)return(OV_EFAULT);
+    memcpy(b,buffer,bytes);
+    ogg_sync_wrote(&vf->oy,bytes);
+    vf->io.read_calls++;
+    vf->io.read_bytes+=bytes;
+  }
+  return 0;
+}
+
+/* as ov_open_callbacks, but returns as soon as the first link's
+   headers are read.  The file is read as a stream until something
+   needs the rest of the links (totals, seeking, other links' info), at
+   which point they're found as a normal open would have. */
+int ov_open_callbacks_fast(void *f,OggVorbis_File *vf,
+    const char *initial,long ibytes,ov_callbacks callbacks){
+  int ret;
+  memset(vf,0,sizeof(*vf));
+  ret=_ov_open1(f,vf,initial,ibytes,callbacks);
   if(ret)return ret;
+  if(vf->seekable){
+    vf->seekable=0;
+    vf->deferred=1;
+  }
   return _ov_open2(vf);
 }
 
@@ -1009,6 +1461,114 @@ int ov_fopen(const char *path,OggVorbis_File *vf){
   return ret;
 }
 
+/* An in-memory data source; 'reading' and 'seeking' are a memcpy and
+   pointer arithmetic, without calls into the OS. */
+typedef struct {
+  const unsigned char *data;
+  ogg_int64_t          size;
+  ogg_int64_t          pos;
+  int                  mapped; /* unmap the data on close */
+} _ov_memsource;
+
+static size_t _mem_read(void *ptr,size_t size,size_t nmemb,void *datasource){
+  _ov_memsource *m=(_ov_memsource *)datasource;
+  ogg_int64_t bytes=(ogg_int64_t)size*nmemb;
+  if(size==0)return 0;
+  if(bytes>m->size-m->pos)bytes=m->size-m->pos;
+  bytes-=bytes%size;
+  memcpy(ptr,m->data+m->pos,(size_t)bytes);
+  m->pos+=bytes;
+  return (size_t)(bytes/size);
+}
+
+static int _mem_seek(void *datasource,ogg_int64_t offset,int whence){
+  _ov_memsource *m=(_ov_memsource *)datasource;
+  switch(whence){
+  case SEEK_SET:
+    break;
+  case SEEK_CUR:
+    offset+=m->pos;
+    break;
+  case SEEK_END:
+    offset+=m->size;
+    break;
+  default:
+    return -1;
+  }
+  if(offset<0 || offset>m->size)return -1;
+  m->pos=offset;
+  return 0;
+}
+
+static int _mem_close(void *datasource){
+  _ov_memsource *m=(_ov_memsource *)datasource;
+#ifdef HAVE_MMAP
+  if(m->mapped)munmap((void *)m->data,(size_t)m->size);
+#endif
+  _ogg_free(m);
+  return 0;
+}
+
+static long _mem_tell(void *datasource){
+  return (long)((_ov_memsource *)datasource)->pos;
+}
+
+static int _ov_open_memsource(_ov_memsource *m,OggVorbis_File *vf){
+  ov_callbacks callbacks = {
+    _mem_read,
+    _mem_seek,
+    _mem_close,
+    _mem_tell
+  };
+  int ret=ov_open_callbacks((void *)m,vf,NULL,0,callbacks);
+  if(ret)_mem_close(m);
+  return ret;
+}
+
+/* open a complete Ogg Vorbis file held in memory.  The buffer belongs
+   to the caller and must outlive vf. */
+int ov_open_memory(const void *buffer,long bytes,OggVorbis_File *vf){
+  _ov_memsource *m;
+  if(!buffer || bytes<0)return OV_EINVAL;
+  m=_ogg_calloc(1,sizeof(*m));
+  if(!m)return OV_EFAULT;
+  m->data=(const unsigned char *)buffer;
+  m->size=bytes;
+  return _ov_open_memsource(m,vf);
+}
+
+/* open a file by mapping it into memory where the platform allows;
+   elsewhere this is ov_fopen() */
+int ov_open_mmap(const char *path,OggVorbis_File *vf){
+#ifdef HAVE_MMAP
+  _ov_memsource *m;
+  struct stat st;
+  void *map;
+  int fd=open(path,O_RDONLY);
+  if(fd<0)return -1;
+  if(fstat(fd,&st) || st.st_size<=0 ||
+     (ogg_int64_t)(size_t)st.st_size!=(ogg_int64_t)st.st_size){
+    close(fd);
+    return -1;
+  }
+  map=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(map==MAP_FAILED)return -1;
+
+  m=_ogg_calloc(1,sizeof(*m));
+  if(!m){
+    munmap(map,(size_t)st.st_size);
+    return OV_EFAULT;
+  }
+  m->data=(const unsigned char *)map;
+  m->size=st.st_size;
+  m->mapped=1;
+  return _ov_open_memsource(m,vf);
+#else
+  return ov_fopen(path,vf);
+#endif
+}
+
 
 /* Only partially open the vorbis file; test for Vorbisness, and load
    the headers for the first chain.  Do not seek (although test for
@@ -1018,6 +1578,7 @@ int ov_fopen(const char *path,OggVorbis_File *vf){
 int ov_test_callbacks(void *f,OggVorbis_File *vf,
     const char *initial,long ibytes,ov_callbacks callbacks)
 {
+  memset(vf,0,sizeof(*vf));
   return _ov_open1(f,vf,initial,ibytes,callbacks);
 }
 
@@ -1037,14 +1598,144 @@ int ov_test_open(OggVorbis_File *vf){
   return _ov_open2(vf);
 }
 
+/* Reads only what a media scanner needs: the identification and
+   comment headers, and the last page for the length.  The setup
+   header is never parsed, so no codebooks or decoder state are built.
+   The length assumes the stream starts at granule position 0 (finding
+   the exact start needs the setup header's modes) and is -1 when it
+   can't be had cheaply: the source can't seek, or the file is
+   chained.  The datasource is left open. */
+int ov_probe(void *f,ov_callbacks callbacks,vorbis_info *vi,
+             vorbis_comment *vc,ogg_int64_t *pcm_total){
+  OggVorbis_File vf;
+  ogg_uint32_t *serialno_list=NULL;
+  int serialno_n=0;
+  int ret;
+
+  if(!f || !vi || !vc)return(OV_EINVAL);
+  if(pcm_total)*pcm_total=-1;
+
+  memset(&vf,0,sizeof(vf));
+  vf.datasource=f;
+  vf.callbacks=callbacks;
+  vf.read_min=vf.read_size=READSIZE;
+  vf.read_max=READSIZE_MAX;
+  ogg_sync_init(&vf.oy);
+  ogg_stream_init(&vf.os,-1);
+
+  ret=_fetch_headers(&vf,vi,vc,&serialno_list,&serialno_n,NULL,2);
+
+  if(!ret && pcm_total && callbacks.seek_func && callbacks.tell_func &&
+     (callbacks.seek_func)(f,0,SEEK_END)!=-1){
+    int serialno=vf.os.serialno;
+    ogg_int64_t granulepos=-1;
+
+    vf.offset=vf.end=(callbacks.tell_func)(f);
+    if(vf.end>=0 &&
+       _get_prev_page_serial(&vf,vf.end,serialno_list,serialno_n,
+                             &serialno,&granulepos,NULL)>=0 &&
+       serialno==vf.os.serialno && granulepos>=0)
+      *pcm_total=granulepos;
+  }
+
+  if(serialno_list)_ogg_free(serialno_list);
+  ogg_stream_clear(&vf.os);
+  ogg_sync_clear(&vf.oy);
+  return(ret);
+}
+
 /* How many logical bitstreams in this physical bitstream? */
 long ov_streams(OggVorbis_File *vf){
+  _ov_discover(vf);
   return vf->links;
 }
 
 /* Is the FILE * associated with vf seekable? */
 long ov_seekable(OggVorbis_File *vf){
-  return vf->seekable;
+  return vf->seekable || vf->deferred;
+}
+
+/* Set the byte counts asked of read_func: minsize after each seek,
+   doubling while reading sequentially up to maxsize.  Setting both
+   to READSIZE gives fixed size reads.  Takes effect from the next
+   read. */
+int ov_read_policy(OggVorbis_File *vf,long minsize,long maxsize){
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  if(minsize<=0 || maxsize<minsize)return(OV_EINVAL);
+  vf->read_min=minsize;
+  vf->read_max=maxsize;
+  if(vf->read_size<minsize)vf->read_size=minsize;
+  if(vf->read_size>maxsize)vf->read_size=maxsize;
+  return(0);
+}
+
+/* read_func/seek_func calls made and bytes read since open */
+int ov_io_stats(OggVorbis_File *vf,ov_io_counters *counters){
+  if(vf->ready_state<OPENED || !counters)return(OV_EINVAL);
+  *counters=vf->io;
+  return(0);
+}
+
+/* bytes the decoder for link i takes, or will take once decoding
+   starts, for its codebooks, lookups and buffers.  Sized from the
+   setup header; see vorbis_synthesis_memory() */
+long ov_memory_required(OggVorbis_File *vf,int i){
+  vorbis_info *vi;
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  vi=ov_info(vf,i);
+  if(!vi)return(OV_EINVAL);
+  return(vorbis_synthesis_memory(vi));
+}
+
+/* bytes held by vf right now, by what they're for.  Heap overhead
+   and the OggVorbis_File struct itself aren't counted. */
+int ov_memory_usage(OggVorbis_File *vf,ov_memory_breakdown *breakdown){
+  vorbis_memory m;
+  ov_memory_breakdown *b=breakdown;
+  long links=0;
+  int i;
+
+  if(vf->ready_state<OPENED || !breakdown)return(OV_EINVAL);
+  memset(&m,0,sizeof(m));
+  memset(b,0,sizeof(*b));
+
+  if(vf->vi){
+    links=vf->links;
+    for(i=0;i<vf->links;i++)
+      vorbis_memory_usage(vf->vi+i,vf->vc+i,NULL,NULL,&m);
+  }
+  if(vf->ready_state==INITSET)
+    vorbis_memory_usage(NULL,NULL,&vf->vd,&vf->vb,&m);
+
+  b->setup=m.setup;
+  b->codebooks=m.codebooks;
+  b->lookups=m.lookups;
+  b->pcm=m.pcm;
+  b->block=m.block;
+  b->comments=m.comments;
+
+  b->ogg=vf->oy.storage+vf->os.body_storage+
+    vf->os.lacing_storage*(sizeof(*vf->os.lacing_vals)+
+			   sizeof(*vf->os.granule_vals));
+
+  /* until the links are found (streaming, or a deferred open) the
+     tables hold one link and the first link's serial number list */
+  b->links=links*(sizeof(*vf->vi)+sizeof(*vf->vc));
+  if(vf->seekable){
+    if(vf->offsets)b->links+=(links+1)*sizeof(*vf->offsets);
+    if(vf->dataoffsets)b->links+=links*sizeof(*vf->dataoffsets);
+    if(vf->serialnos)b->links+=links*sizeof(*vf->serialnos);
+    if(vf->pcmlengths)b->links+=links*2*sizeof(*vf->pcmlengths);
+  }else{
+    if(vf->offsets)b->links+=sizeof(*vf->offsets);
+    if(vf->dataoffsets)b->links+=sizeof(*vf->dataoffsets);
+    if(vf->serialnos)b->links+=(vf->serialnos[1]+2)*sizeof(*vf->serialnos);
+  }
+  b->links+=vf->index_alloc*sizeof(*vf->index);
+
+  b->total=b->setup+b->codebooks+b->lookups+b->pcm+b->block+
+    b->comments+b->ogg+b->links;
+  return(0);
 }
 
 /* returns the bitrate for a given logical bitstream or the entire
@@ -1058,6 +1749,7 @@ long ov_seekable(OggVorbis_File *vf){
 
 long ov_bitrate(OggVorbis_File *vf,int i){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(i>=vf->links)return(OV_EINVAL);
   if(!vf->seekable && i!=0)return(ov_bitrate(vf,0));
   if(i<0){
@@ -1109,6 +1801,7 @@ long ov_bitrate_instant(OggVorbis_File *vf){
 
 /* Guess */
 long ov_serialnumber(OggVorbis_File *vf,int i){
+  if(i>=0)_ov_discover(vf);
   if(i>=vf->links)return(ov_serialnumber(vf,vf->links-1));
   if(!vf->seekable && i>=0)return(ov_serialnumber(vf,-1));
   if(i<0){
@@ -1125,6 +1818,7 @@ long ov_serialnumber(OggVorbis_File *vf,int i){
 */
 ogg_int64_t ov_raw_total(OggVorbis_File *vf,int i){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable || i>=vf->links)return(OV_EINVAL);
   if(i<0){
     ogg_int64_t acc=0;
@@ -1144,6 +1838,7 @@ ogg_int64_t ov_raw_total(OggVorbis_File *vf,int i){
 */
 ogg_int64_t ov_pcm_total(OggVorbis_File *vf,int i){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable || i>=vf->links)return(OV_EINVAL);
   if(i<0){
     ogg_int64_t acc=0;
@@ -1152,7 +1847,7 @@ ogg_int64_t ov_pcm_total(OggVorbis_File *vf,int i){
       acc+=ov_pcm_total(vf,i);
     return(acc);
   }else{
-    return(vf->pcmlengths[i*2+1]);
+    return(vf->pcmlengths[i*2+1]>>_halfrate_shift(vf));
   }
 }
 
@@ -1163,6 +1858,7 @@ ogg_int64_t ov_pcm_total(OggVorbis_File *vf,int i){
 */
 ogg_int64_t ov_time_total(OggVorbis_File *vf,int i){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable || i>=vf->links)return(OV_EINVAL);
   if(i<0){
     ogg_int64_t acc=0;
@@ -1175,6 +1871,152 @@ ogg_int64_t ov_time_total(OggVorbis_File *vf,int i){
   }
 }
 
+/* Record a seek index entry for every page at least 'spacing' pcm
+   samples past the last one recorded (every page with a granulepos
+   if spacing<=0), across all links.  Reads the whole file once; the
+   decode position is left where it was.  Later page seeks start from
+   the indexed pages either side of their target. */
+int ov_index_build(OggVorbis_File *vf,ogg_int64_t spacing){
+  ogg_int64_t saved=vf->offset;
+  ogg_page og;
+  int link,ret=0;
+
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
+  if(!vf->seekable)return(OV_ENOSEEK);
+  if(spacing<0)spacing=0;
+  spacing<<=_halfrate_shift(vf);
+
+  for(link=0;link<vf->links && !ret;link++){
+    ogg_int64_t end=vf->offsets[link+1];
+    ogg_int64_t last=-1;
+
+    ret=_seek_helper(vf,vf->dataoffsets[link]);
+    while(!ret && vf->offset<end){
+      ogg_int64_t granulepos;
+      ogg_int64_t offset=_get_next_page(vf,&og,end-vf->offset);
+      if(offset==OV_EREAD)ret=OV_EREAD;
+      if(offset<0)break;
+
+      if(ogg_page_serialno(&og)!=vf->serialnos[link])continue;
+      granulepos=ogg_page_granulepos(&og);
+      if(granulepos==-1)continue;
+      if(last==-1 || granulepos-last>=spacing){
+        ret=_index_add(vf,link,granulepos,offset,vf->offset);
+        last=granulepos;
+      }
+    }
+  }
+
+  /* resume reading where the decoder left off */
+  if(_seek_helper(vf,saved) && !ret)ret=OV_EREAD;
+  return(ret);
+}
+
+/* The serialized index is little endian throughout:
+     "OVIX", version, links
+     per link:  serialno, end offset, entry count
+     per entry: granulepos, offset, next
+   with 32 bit versions, counts and serialnos and 64 bit positions.
+   The per link fields tie it to the file it was built from. */
+
+#define OV_INDEX_VERSION 1
+
+static unsigned char *_index_put(unsigned char *p,ogg_int64_t v,int bytes){
+  int i;
+  for(i=0;i<bytes;i++,v>>=8)
+    *p++=(unsigned char)(v&0xff);
+  return p;
+}
+
+static ogg_int64_t _index_get(const unsigned char **p,int bytes){
+  ogg_int64_t v=0;
+  int i;
+  for(i=bytes-1;i>=0;i--)
+    v=(v<<8)|(*p)[i];
+  *p+=bytes;
+  return v;
+}
+
+/* write the index into buffer; returns the bytes needed, writing
+   nothing if buffer is NULL */
+long ov_index_save(OggVorbis_File *vf,void *buffer,long bytes){
+  unsigned char *p=(unsigned char *)buffer;
+  long i,size;
+  int link;
+
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
+  size=12+16*vf->links+24*vf->index_entries;
+  if(!p)return(size);
+  if(bytes<size)return(OV_EINVAL);
+
+  memcpy(p,"OVIX",4);
+  p=_index_put(p+4,OV_INDEX_VERSION,4);
+  p=_index_put(p,vf->links,4);
+  for(link=0,i=0;link<vf->links;link++){
+    long n=0;
+    while(i+n<vf->index_entries && vf->index[i+n].link==link)n++;
+    p=_index_put(p,vf->serialnos[link],4);
+    p=_index_put(p,vf->offsets[link+1],8);
+    p=_index_put(p,n,4);
+    i+=n;
+  }
+  for(i=0;i<vf->index_entries;i++){
+    p=_index_put(p,vf->index[i].granulepos,8);
+    p=_index_put(p,vf->index[i].offset,8);
+    p=_index_put(p,vf->index[i].next,8);
+  }
+  return(size);
+}
+
+/* replace the index with one saved by ov_index_save() from this same
+   file */
+int ov_index_load(OggVorbis_File *vf,const void *buffer,long bytes){
+  const unsigned char *p=(const unsigned char *)buffer;
+  const unsigned char *q;
+  long entries=0;
+  int link;
+
+  if(vf->ready_state<OPENED || !p)return(OV_EINVAL);
+  _ov_discover(vf);
+  if(!vf->seekable)return(OV_ENOSEEK);
+  if(bytes<12 || memcmp(p,"OVIX",4))return(OV_EBADHEADER);
+  p+=4;
+  if(_index_get(&p,4)!=OV_INDEX_VERSION)return(OV_EVERSION);
+  if(_index_get(&p,4)!=vf->links)return(OV_EBADLINK);
+  if(bytes<12+16*vf->links)return(OV_EBADHEADER);
+
+  /* check it belongs to this file before touching the current index */
+  q=p;
+  for(link=0;link<vf->links;link++){
+    if(_index_get(&q,4)!=vf->serialnos[link] ||
+       _index_get(&q,8)!=vf->offsets[link+1])return(OV_EBADLINK);
+    entries+=(long)_index_get(&q,4);
+  }
+  if(entries<0 || (bytes-12-16*vf->links)/24<entries)return(OV_EBADHEADER);
+
+  _index_clear(vf);
+  for(link=0;link<vf->links;link++){
+    /* offsets[links] is where the final link's last page starts */
+    ogg_int64_t end=(link+1<vf->links?vf->offsets[link+1]:vf->end);
+    long n;
+    p+=12;
+    n=(long)_index_get(&p,4);
+    while(n--){
+      ogg_int64_t granulepos=_index_get(&q,8);
+      ogg_int64_t offset=_index_get(&q,8);
+      ogg_int64_t next=_index_get(&q,8);
+      if(offset<vf->dataoffsets[link] || next<=offset || next>end){
+        _index_clear(vf);
+        return(OV_EBADHEADER);
+      }
+      if(_index_add(vf,link,granulepos,offset,next))return(OV_EFAULT);
+    }
+  }
+  return(0);
+}
+
 /* seek to an offset relative to the *compressed* data. This also
    scans packets to update the PCM cursor. It will cross a logical
    bitstream boundary, but only if it can't get any packets out of the
@@ -1186,6 +2028,7 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
   ogg_stream_state work_os;
 
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable)
     return(OV_ENOSEEK); /* don't dump machine if we can't seek */
 
@@ -1291,7 +2134,7 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
       if(!lastblock){
         pagepos=_get_next_page(vf,&og,-1);
         if(pagepos<0){
-          vf->pcm_offset=ov_pcm_total(vf,-1);
+          vf->pcm_offset=_pcm_total(vf);
           break;
         }
       }else{
@@ -1334,6 +2177,8 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
         firstflag=(pagepos<=vf->dataoffsets[link]);
       }
 
+      if(ogg_page_serialno(&og)==vf->current_serialno)
+        _index_learn(vf,vf->current_link,&og);
       ogg_stream_pagein(&vf->os,&og);
       ogg_stream_pagein(&work_os,&og);
       lastflag=ogg_page_eos(&og);
@@ -1382,15 +2227,17 @@ ogg_int64_t rescale64(ogg_int64_t x, ogg_int64_t from, ogg_int64_t to){
 
    Seek to the last [granule marked] page preceding the specified pos
    location, such that decoding past the returned point will quickly
-   arrive at the requested position. */
-int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+   arrive at the requested position.  pos is in stream units. */
+static int _ov_pcm_seek_page1(OggVorbis_File *vf,ogg_int64_t pos){
   int link=-1;
   ogg_int64_t result=0;
-  ogg_int64_t total=ov_pcm_total(vf,-1);
+  ogg_int64_t total;
 
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable)return(OV_ENOSEEK);
 
+  total=_pcm_total(vf);
   if(pos<0 || pos>total)return(OV_EINVAL);
 
   /* which bitstream section does this pcm offset occur in? */
@@ -1418,7 +2265,13 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
     ogg_int64_t endtime = vf->pcmlengths[link*2+1]+begintime;
     ogg_int64_t target=pos-total+begintime;
     ogg_int64_t best=-1;
+    ogg_int64_t width=-1;     /* bracket at the last probe */
+    ogg_int64_t second=vf->vi[link].rate; /* one second of audio */
     int         got_page=0;
+    int         slow=0;       /* guesses in a row that didn't halve it */
+    int         probed=0;     /* next page found is a probe's first */
+    ogg_int64_t lastpos=-1,lasttime=0; /* pages found by the last two */
+    ogg_int64_t thispos=-1,thistime=0; /* probes */
 
     ogg_page og;
 
@@ -1433,21 +2286,84 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
       got_page=1;
     }
 
-    /* bisection loop */
+    /* start from the indexed pages either side of the target, if
+       any, as if bisection had already found them */
+    if(vf->index_entries && begin<end){
+      long i=_index_find(vf,link,target);
+      if(i>0 && vf->index[i-1].link==link){
+        ov_index_entry *e=vf->index+i-1;
+        best=e->offset;
+        begin=e->next;
+        begintime=e->granulepos;
+        if(i<vf->index_entries && vf->index[i].link==link &&
+           vf->index[i].offset>=begin){
+          end=vf->index[i].offset;
+          endtime=vf->index[i].granulepos;
+        }
+      }
+    }
+
+    /* bisection loop.  Guesses come from a bitrate model built from
+       the pages seen.  The first page found by each of the last two
+       probes gives the local bitrate; for the first probe, the other
+       point is the end of the bracket that its page replaced.  The
+       next guess follows that secant while it stays inside the
+       bracket and doesn't reach further than the two points are
+       apart.  Otherwise the guess assumes a constant rate between the
+       bracketing pages (regula falsi).  A guess that twice failed to
+       halve the bracket is followed by a plain bisection.  Guesses aim
+       a second of audio short of the target, so the page found
+       usually precedes it, and anything less than three chunks ahead
+       is reached by reading on: on VBR files with quiet or loud
+       stretches that absorbs most of the model's error for less than
+       another probe costs. */
     while(begin<end){
       ogg_int64_t bisect;
 
+      /* did the last probe at least halve the bracket? */
+      if(width>=0){
+        slow=(end-begin>width/2 ? slow+1 : 0);
+        width=-1;
+      }
+
       if(end-begin<CHUNKSIZE){
         bisect=begin;
+      }else if(slow>=2){
+        bisect=begin+(end-begin)/2;
+        slow=0;
       }else{
-        /* take a (pretty decent) guess. */
-        bisect=begin + rescale64(target-begintime,
-				 endtime-begintime,
-				 end-begin) - CHUNKSIZE;
-        if(bisect<begin+CHUNKSIZE)
+        ogg_int64_t guess=-1;
+
+        if(lastpos>=0 && thistime!=lasttime &&
+           (thispos>lastpos)==(thistime>lasttime)){
+          ogg_int64_t span=(thistime>lasttime ?
+                            thistime-lasttime : lasttime-thistime);
+          ogg_int64_t bytes=(thispos>lastpos ?
+                             thispos-lastpos : lastpos-thispos);
+          ogg_int64_t margin=rescale64(second,span,bytes);
+          if(target>=thistime && target-thistime<span)
+            guess=thispos+rescale64(target-thistime,span,bytes)-margin;
+          if(target<thistime && thistime-target<span)
+            guess=thispos-rescale64(thistime-target,span,bytes)-margin;
+        }
+
+        if(guess<=begin || guess>=end){
+          guess=begin + rescale64(target-begintime,endtime-begintime,
+                                  end-begin)
+            - rescale64(second,endtime-begintime,end-begin);
+        }
+
+        /* close enough ahead to just read on */
+        bisect=guess;
+        if(bisect<begin+CHUNKSIZE*3)
           bisect=begin;
       }
 
+      if(bisect!=vf->offset){
+        vf->io.seek_probes++;
+        probed=1;
+        width=end-begin;
+      }
       result=_seek_helper(vf,bisect);
       if(result) goto seek_error;
 
@@ -1471,6 +2387,7 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
             if(bisect<=begin)bisect=begin+1;
 
             /* seek and continue bisection */
+            if(bisect!=vf->offset)vf->io.seek_probes++;
             result=_seek_helper(vf,bisect);
             if(result) goto seek_error;
           }
@@ -1486,6 +2403,19 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
           /* only consider pages with the granulepos set */
           granulepos=ogg_page_granulepos(&og);
           if(granulepos==-1)continue;
+          _index_learn(vf,link,&og);
+
+          if(probed){
+            lastpos=thispos;
+            lasttime=thistime;
+            if(lastpos<0){
+              lastpos=(granulepos<target ? begin : end);
+              lasttime=(granulepos<target ? begintime : endtime);
+            }
+            thispos=result;
+            thistime=granulepos;
+            probed=0;
+          }
 
           if(granulepos<target){
             /* this page is a successful candidate! Set state */
@@ -1518,6 +2448,7 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
                 end=result;
                 bisect-=CHUNKSIZE;
                 if(bisect<=begin)bisect=begin+1;
+                if(bisect!=vf->offset)vf->io.seek_probes++;
                 result=_seek_helper(vf,bisect);
                 if(result) goto seek_error;
               }else{
@@ -1636,7 +2567,7 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   }
 
   /* verify result */
-  if(vf->pcm_offset>pos || pos>ov_pcm_total(vf,-1)){
+  if(vf->pcm_offset>pos || pos>_pcm_total(vf)){
     result=OV_EFAULT;
     goto seek_error;
   }
@@ -1651,17 +2582,40 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   return (int)result;
 }
 
-/* seek to a sample offset relative to the decompressed pcm stream
-   returns zero on success, nonzero on failure */
+/* count the probes and bytes the search takes */
+static int _ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+  ogg_int64_t bytes=vf->io.read_bytes;
+  int ret;
 
-int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
-  int thisblock,lastblock=0;
-  int ret=ov_pcm_seek_page(vf,pos);
+  vf->io.seek_probes=0;
+  ret=_ov_pcm_seek_page1(vf,pos);
+  vf->io.seek_bytes=vf->io.read_bytes-bytes;
+  return(ret);
+}
+
+/* as above; pos is in output samples */
+int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+  if(pos<0)return(OV_EINVAL);
+  return(_ov_pcm_seek_page(vf,pos<<_halfrate_shift(vf)));
+}
+
+/* seek to a sample offset (in stream units) relative to the
+   decompressed pcm stream returns zero on success, nonzero on
+   failure */
+
+static int _ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+  int hs=_halfrate_shift(vf);
+  int thisblock,nextblock,lastblock=0;
+  int ret=_ov_pcm_seek_page(vf,pos);
   if(ret<0)return(ret);
   if((ret=_make_decode_ready(vf)))return ret;
 
   /* discard leading packets we don't need for the lapping of the
-     position we want; don't decode them */
+     position we want; don't decode them.  Only two packets are
+     decoded: the one whose returned span holds pos, and the one
+     before it, which supplies nothing but the right half it laps
+     with (vorbis_synthesis_blockin doesn't lap into a block whose
+     output is discarded anyway). */
 
   while(1){
     ogg_packet op;
@@ -1676,8 +2630,14 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
       }
       if(lastblock)vf->pcm_offset+=(lastblock+thisblock)>>2;
 
-      if(vf->pcm_offset+((thisblock+
-                          vorbis_info_blocksize(vf->vi,1))>>2)>=pos)break;
+      /* pcm_offset is now where this packet's returned span ends; the
+         next one's ends a quarter of each block further on.  Long
+         blocks say how big the next is; after a short one assume the
+         worst */
+      nextblock=vorbis_packet_nextblocksize(vf->vi+vf->current_link,&op);
+      if(nextblock<=0)
+        nextblock=vorbis_info_blocksize(vf->vi+vf->current_link,1);
+      if(vf->pcm_offset+((thisblock+nextblock)>>2)>pos)break;
 
       /* remove the packet from packet queue and track its granulepos */
       ogg_stream_packetout(&vf->os,NULL);
@@ -1724,6 +2684,8 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
         lastblock=0;
       }
 
+      if(ogg_page_serialno(&og)==vf->current_serialno)
+        _index_learn(vf,vf->current_link,&og);
       ogg_stream_pagein(&vf->os,&og);
     }
   }
@@ -1733,20 +2695,101 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
   /* discard samples until we reach the desired position. Crossing a
      logical bitstream boundary with abandon is OK. */
   while(vf->pcm_offset<pos){
-    ogg_int64_t target=pos-vf->pcm_offset;
+    ogg_int64_t target=(pos-vf->pcm_offset+(1<<hs)-1)>>hs;
     long samples=vorbis_synthesis_pcmout(&vf->vd,NULL);
 
     if(samples>target)samples=target;
     vorbis_synthesis_read(&vf->vd,samples);
-    vf->pcm_offset+=samples;
+    vf->pcm_offset+=(ogg_int64_t)samples<<hs;
 
     if(samples<target)
       if(_fetch_and_process_packet(vf,NULL,1,1)<=0)
-        vf->pcm_offset=ov_pcm_total(vf,-1); /* eof */
+        vf->pcm_offset=_pcm_total(vf); /* eof */
   }
   return 0;
 }
 
+/* seek to a sample offset relative to the decompressed pcm stream
+   returns zero on success, nonzero on failure */
+
+int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+  if(pos<0)return(OV_EINVAL);
+  return(_ov_pcm_seek(vf,pos<<_halfrate_shift(vf)));
+}
+
+/* clear out stream state after a decode setup option has changed;
+   dumping the decode machine is needed to reinit the MDCT lookups.
+   It is rebuilt by the seek back to the current position. */
+static void _ov_rebuild(OggVorbis_File *vf){
+  if(vf->ready_state>STREAMSET){
+    _ov_discover(vf);
+    vorbis_dsp_clear(&vf->vd);
+    vorbis_block_clear(&vf->vb);
+    vf->ready_state=STREAMSET;
+    if(vf->pcm_offset>=0){
+      ogg_int64_t pos=vf->pcm_offset;
+      vf->pcm_offset=-1; /* make sure the pos is dumped if unseekable */
+      _ov_pcm_seek(vf,pos);
+    }
+  }
+}
+
+/* Select half-rate decode for every link: the decoder returns one
+   sample for every two in the stream, and all pcm sample positions
+   (ov_pcm_total, ov_pcm_tell, ov_pcm_seek...) are reported in those
+   output samples.  May be toggled mid-stream; the decode machine is
+   rebuilt and, if possible, repositioned to the same place. */
+int ov_halfrate(OggVorbis_File *vf,int flag){
+  int i;
+  if(vf->vi==NULL)return OV_EINVAL;
+
+  for(i=0;i<vf->links;i++){
+    if(vorbis_synthesis_halfrate(vf->vi+i,flag)){
+      if(flag) ov_halfrate(vf,0);
+      return OV_EINVAL;
+    }
+  }
+
+  _ov_rebuild(vf);
+  return 0;
+}
+
+int ov_halfrate_p(OggVorbis_File *vf){
+  if(vf->vi==NULL)return OV_EINVAL;
+  return vorbis_synthesis_halfrate_p(vf->vi);
+}
+
+/* Limit every link to the first 'stages' residue cascade passes, or
+   restore full decode with 0.  Takes effect from the next packet. */
+int ov_preview(OggVorbis_File *vf,int stages){
+  int i;
+  if(vf->vi==NULL || stages<0)return OV_EINVAL;
+
+  for(i=0;i<vf->links;i++)
+    vorbis_synthesis_preview(vf->vi+i,stages);
+  return 0;
+}
+
+/* Decode every link with the low accuracy kernels, or clear that with
+   0; see vorbis_synthesis_lowaccuracy().  May be toggled mid-stream
+   like ov_halfrate(). */
+int ov_lowaccuracy(OggVorbis_File *vf,int flag){
+  int i;
+  if(vf->vi==NULL)return OV_EINVAL;
+
+  for(i=0;i<vf->links;i++)
+    if(vorbis_synthesis_lowaccuracy(vf->vi+i,flag))
+      return OV_EINVAL;
+
+  _ov_rebuild(vf);
+  return 0;
+}
+
+int ov_lowaccuracy_p(OggVorbis_File *vf){
+  if(vf->vi==NULL)return OV_EINVAL;
+  return vorbis_synthesis_lowaccuracy_p(vf->vi);
+}
+
 /* seek to a playback time relative to the decompressed pcm stream
    returns zero on success, nonzero on failure */
 int ov_time_seek(OggVorbis_File *vf,ogg_int64_t milliseconds){
@@ -1757,6 +2800,7 @@ int ov_time_seek(OggVorbis_File *vf,ogg_int64_t milliseconds){
   ogg_int64_t time_total=0;
 
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable)return(OV_ENOSEEK);
   if(milliseconds<0)return(OV_EINVAL);
 
@@ -1773,7 +2817,7 @@ int ov_time_seek(OggVorbis_File *vf,ogg_int64_t milliseconds){
   /* enough information to convert time offset to pcm offset */
   {
     ogg_int64_t target=pcm_total+(milliseconds-time_total)*vf->vi[link].rate/1000;
-    return(ov_pcm_seek(vf,target));
+    return(_ov_pcm_seek(vf,target));
   }
 }
 
@@ -1787,6 +2831,7 @@ int ov_time_seek_page(OggVorbis_File *vf,ogg_int64_t milliseconds){
   ogg_int64_t time_total=0;
 
   if(vf->ready_state<OPENED)return(OV_EINVAL);
+  _ov_discover(vf);
   if(!vf->seekable)return(OV_ENOSEEK);
   if(milliseconds<0)return(OV_EINVAL);
 
@@ -1803,7 +2848,7 @@ int ov_time_seek_page(OggVorbis_File *vf,ogg_int64_t milliseconds){
   /* enough information to convert time offset to pcm offset */
   {
     ogg_int64_t target=pcm_total+(milliseconds-time_total)*vf->vi[link].rate/1000;
-    return(ov_pcm_seek_page(vf,target));
+    return(_ov_pcm_seek_page(vf,target));
   }
 }
 
@@ -1817,7 +2862,7 @@ ogg_int64_t ov_raw_tell(OggVorbis_File *vf){
 /* return PCM offset (sample) of next PCM sample to be read */
 ogg_int64_t ov_pcm_tell(OggVorbis_File *vf){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
-  return(vf->pcm_offset);
+  return(vf->pcm_offset>>_halfrate_shift(vf));
 }
 
 /* return time offset (milliseconds) of next PCM sample to be read */
@@ -1828,7 +2873,7 @@ ogg_int64_t ov_time_tell(OggVorbis_File *vf){
 
   if(vf->ready_state<OPENED)return(OV_EINVAL);
   if(vf->seekable){
-    pcm_total=ov_pcm_total(vf,-1);
+    pcm_total=_pcm_total(vf);
     time_total=ov_time_total(vf,-1);
 
     /* which bitstream section does this time offset occur in? */
@@ -1851,6 +2896,7 @@ ogg_int64_t ov_time_tell(OggVorbis_File *vf){
     initialized */
 
 vorbis_info *ov_info(OggVorbis_File *vf,int link){
+  if(link>=0)_ov_discover(vf);
   if(vf->seekable){
     if(link<0)
       if(vf->ready_state>=STREAMSET)
@@ -1869,6 +2915,7 @@ vorbis_info *ov_info(OggVorbis_File *vf,int link){
 
 /* grr, strong typing, grr, no templates/inheritence, grr */
 vorbis_comment *ov_comment(OggVorbis_File *vf,int link){
+  if(link>=0)_ov_discover(vf);
   if(vf->seekable){
     if(link<0)
       if(vf->ready_state>=STREAMSET)
@@ -1885,6 +2932,80 @@ vorbis_comment *ov_comment(OggVorbis_File *vf,int link){
   }
 }
 
+/* copy comment field i of a link into buffer, rereading it from the
+   link's comment header if it was left out when the file was opened.
+   Returns the length of the field, copying nothing if buffer is
+   NULL. */
+int ov_comment_fetch(OggVorbis_File *vf,int link,int i,
+                     char *buffer,int bytes){
+  vorbis_comment *vc;
+  OggVorbis_File hf;
+  ogg_page og;
+  ogg_packet op;
+  long pos;
+  int ret,packets=0;
+
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  vc=ov_comment(vf,link);
+  if(!vc || !vc->field_lengths || i<0 || i>=vc->comments)return(OV_EINVAL);
+  if(!buffer || vc->comment_lengths[i]==vc->field_lengths[i])
+    return(vorbis_comment_fetch(vc,NULL,i,buffer,bytes));
+
+  /* the field is only in the stream; without seeking it's gone */
+  if(bytes<vc->field_lengths[i])return(OV_EINVAL);
+  if(vf->deferred){
+    link=(link<0?vf->current_link:link);
+    _ov_discover(vf);
+    vc=ov_comment(vf,link);
+    if(!vc)return(OV_EINVAL);
+  }
+  if(!vf->seekable || !vf->callbacks.tell_func)return(OV_ENOSEEK);
+  link=vc-vf->vc;
+
+  /* read the header with its own sync state, then put the datasource
+     back where the decode left it */
+  pos=(vf->callbacks.tell_func)(vf->datasource);
+  memset(&hf,0,sizeof(hf));
+  hf.datasource=vf->datasource;
+  hf.callbacks=vf->callbacks;
+  hf.read_min=hf.read_size=READSIZE;
+  hf.read_max=READSIZE_MAX;
+  hf.offset=-1;
+  ogg_sync_init(&hf.oy);
+  ogg_stream_init(&hf.os,vf->serialnos[link]);
+
+  ret=_seek_helper(&hf,vf->offsets[link]);
+  while(!ret){
+    int result=ogg_stream_packetout(&hf.os,&op);
+    if(result<0){
+      ret=OV_EBADHEADER;
+      break;
+    }
+    if(result>0){
+      if(++packets==2){
+        ret=vorbis_comment_fetch(vc,&op,i,buffer,bytes);
+        break;
+      }
+      continue;
+    }
+    if(_get_next_page(&hf,&og,CHUNKSIZE)<0){
+      ret=OV_EBADHEADER;
+      break;
+    }
+    if(ogg_page_serialno(&og)==vf->serialnos[link])
+      ogg_stream_pagein(&hf.os,&og);
+  }
+
+  ogg_stream_clear(&hf.os);
+  ogg_sync_clear(&hf.oy);
+  vf->io.read_calls+=hf.io.read_calls;
+  vf->io.read_bytes+=hf.io.read_bytes;
+  vf->io.seek_calls+=hf.io.seek_calls+1;
+  if((vf->callbacks.seek_func)(vf->datasource,pos,SEEK_SET)==-1)
+    return(OV_EREAD);
+  return(ret);
+}
+
 /* up to this point, everything could more or less hide the multiple
    logical bitstream nature of chaining from the toplevel application
    if the toplevel application didn't particularly care.  However, at
@@ -1956,10 +3077,301 @@ long ov_read(OggVorbis_File *vf,char *buffer,int bytes_req,int *bitstream){
     }
 
     vorbis_synthesis_read(&vf->vd,samples);
-    vf->pcm_offset+=samples;
+    vf->pcm_offset+=(ogg_int64_t)samples<<_halfrate_shift(vf);
     if(bitstream)*bitstream=vf->current_link;
     return(samples*2*channels);
   }else{
     return(samples);
   }
 }
+
+/* input values: pcm_channels) set to a fixed point (Q.OV_FIXED_FRACBITS)
+				vector per channel of output; the vectors
+				point into the decoder and remain valid
+				until the next call into the decoder
+		 length) the sample length being read by the app
+
+   return values: <0) error/hole in data (OV_HOLE), partial open (OV_EINVAL)
+                   0) EOF
+		   n) number of samples of PCM actually returned.  The
+		   below works on a packet-by-packet basis, so the
+		   return length is not related to the 'length' passed
+		   in, just guaranteed to fit.
+
+	    *section) set to the logical bitstream number */
+
+long ov_read_fixed(OggVorbis_File *vf,ogg_int32_t ***pcm_channels,int length,
+		   int *bitstream){
+
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+
+  while(1){
+    if(vf->ready_state==INITSET){
+      ogg_int32_t **pcm;
+      long samples=vorbis_synthesis_pcmout(&vf->vd,&pcm);
+      if(samples){
+	if(pcm_channels)*pcm_channels=pcm;
+	if(samples>length)samples=length;
+	vorbis_synthesis_read(&vf->vd,samples);
+	vf->pcm_offset+=(ogg_int64_t)samples<<_halfrate_shift(vf);
+	if(bitstream)*bitstream=vf->current_link;
+	return samples;
+      }
+    }
+
+    /* suck in another packet */
+    {
+      int ret=_fetch_and_process_packet(vf,NULL,1,1);
+      if(ret==OV_EOF)return(0);
+      if(ret<=0)return(ret);
+    }
+
+  }
+}
+
+/* output packing for ov_read_format().  Each sample encoding has a
+   scalar converter; the layout helpers below apply it to whole runs:
+
+     planar data, or a single channel, is one unit-stride run per channel
+     two channels are interleaved by a single loop over both inputs
+     anything wider walks the output one frame at a time
+
+   The run and pair loops work in blocks of PACK_BLOCK samples with
+   restrict-qualified pointers.  The fixed inner trip count means GCC
+   needs neither a runtime alias check nor a vector epilogue, so it
+   vectorizes them at plain -O2 (check with -fopt-info-vec); the tail
+   and the frame walk stay scalar.  Byte swapping happens in the
+   converter, inside the same store.  A byte swapped float32 cannot be
+   vectorized on SSE2 or NEON (the compiler won't treat the float as a
+   word in a vector) and s24 is three byte stores, so those two are
+   scalar whatever the layout. */
+
+#define PACK_BLOCK 16
+
+static int host_is_big_endian(void){
+  ogg_int32_t pattern = 0xfeedface; /* deadbeef */
+  unsigned char *bytewise = (unsigned char *)&pattern;
+  if (bytewise[0] == 0xfe) return 1;
+  return 0;
+}
+
+STIN ogg_uint32_t _swap32(ogg_uint32_t v){
+  return (v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+}
+
+STIN unsigned char _cvt_u8(ogg_int32_t v){
+  v>>=OV_FIXED_FRACBITS-7;
+  v=(v>127?127:v);
+  v=(v<-128?-128:v);
+  return (unsigned char)(v+128);
+}
+
+STIN unsigned short _cvt_s16(ogg_int32_t v){
+  v>>=OV_FIXED_FRACBITS-15;
+  v=(v>32767?32767:v);
+  v=(v<-32768?-32768:v);
+  return (unsigned short)v;
+}
+
+STIN unsigned short _cvt_s16x(ogg_int32_t v){
+  unsigned short w=_cvt_s16(v);
+  return (unsigned short)((w>>8)|(w<<8));
+}
+
+STIN ogg_uint32_t _cvt_s32(ogg_int32_t v){
+  const ogg_int32_t lim=(1<<OV_FIXED_FRACBITS)-1;
+  v=(v>lim?lim:v);
+  v=(v<-lim-1?-lim-1:v);
+  return (ogg_uint32_t)v<<(31-OV_FIXED_FRACBITS);
+}
+
+STIN ogg_uint32_t _cvt_s32x(ogg_int32_t v){
+  return _swap32(_cvt_s32(v));
+}
+
+STIN float _cvt_f32(ogg_int32_t v){
+  return v*(1.f/(1<<OV_FIXED_FRACBITS));
+}
+
+STIN ogg_uint32_t _cvt_f32x(ogg_int32_t v){
+  /* swap the float's bits as a word, copied rather than aliased */
+  float f=_cvt_f32(v);
+  ogg_uint32_t w;
+  memcpy(&w,&f,sizeof(w));
+  return _swap32(w);
+}
+
+/* expands to _pack_<name>(d,pcm,channels,n,planar) for one converter */
+#define PACK_LAYOUTS(name,type,cvt)					\
+static void _pack_##name##_run(type *OV_RESTRICT d,			\
+			       const ogg_int32_t *OV_RESTRICT s,long n){ \
+  long i;								\
+  for(;n>=PACK_BLOCK;n-=PACK_BLOCK,d+=PACK_BLOCK,s+=PACK_BLOCK)		\
+    for(i=0;i<PACK_BLOCK;i++)						\
+      d[i]=cvt(s[i]);							\
+  for(i=0;i<n;i++)							\
+    d[i]=cvt(s[i]);							\
+}									\
+									\
+static void _pack_##name##_pair(type *OV_RESTRICT d,			\
+				const ogg_int32_t *OV_RESTRICT l,	\
+				const ogg_int32_t *OV_RESTRICT r,long n){ \
+  long i;								\
+  for(;n>=PACK_BLOCK;n-=PACK_BLOCK,d+=2*PACK_BLOCK,l+=PACK_BLOCK,r+=PACK_BLOCK) \
+    for(i=0;i<PACK_BLOCK;i++){						\
+      d[2*i]=cvt(l[i]);							\
+      d[2*i+1]=cvt(r[i]);						\
+    }									\
+  for(i=0;i<n;i++){							\
+    d[2*i]=cvt(l[i]);							\
+    d[2*i+1]=cvt(r[i]);							\
+  }									\
+}									\
+									\
+static void _pack_##name(type *d,ogg_int32_t **pcm,long channels,	\
+			 long n,int planar){				\
+  long i,j;								\
+  if(planar || channels==1){						\
+    for(i=0;i<channels;i++)						\
+      _pack_##name##_run(d+i*n,pcm[i],n);				\
+  }else if(channels==2){						\
+    _pack_##name##_pair(d,pcm[0],pcm[1],n);				\
+  }else{								\
+    for(j=0;j<n;j++)							\
+      for(i=0;i<channels;i++)						\
+	*d++=cvt(pcm[i][j]);						\
+  }									\
+}
+
+PACK_LAYOUTS(u8,unsigned char,_cvt_u8)
+PACK_LAYOUTS(s16,unsigned short,_cvt_s16)
+PACK_LAYOUTS(s16x,unsigned short,_cvt_s16x)
+PACK_LAYOUTS(s32,ogg_uint32_t,_cvt_s32)
+PACK_LAYOUTS(s32x,ogg_uint32_t,_cvt_s32x)
+PACK_LAYOUTS(f32,float,_cvt_f32)
+PACK_LAYOUTS(f32x,ogg_uint32_t,_cvt_f32x)
+
+STIN void _put_s24(unsigned char *d,ogg_int32_t v,int bigendianp){
+  v>>=OV_FIXED_FRACBITS-23;
+  v=(v>8388607?8388607:v);
+  v=(v<-8388608?-8388608:v);
+  d[0]=(unsigned char)(v>>(bigendianp?16:0));
+  d[1]=(unsigned char)(v>>8);
+  d[2]=(unsigned char)(v>>(bigendianp?0:16));
+}
+
+static void _pack_s24(unsigned char *d,ogg_int32_t **pcm,long channels,
+		      long n,int planar,int bigendianp){
+  long i,j;
+  if(planar){
+    for(i=0;i<channels;i++)
+      for(j=0;j<n;j++,d+=3)
+	_put_s24(d,pcm[i][j],bigendianp);
+  }else{
+    for(j=0;j<n;j++)
+      for(i=0;i<channels;i++,d+=3)
+	_put_s24(d,pcm[i][j],bigendianp);
+  }
+}
+
+/* input values: buffer) a buffer to hold packed PCM data for return;
+		         must be aligned for the sample word size
+		 length) the byte length requested to be placed into buffer
+		 format) sample encoding, byte order and layout of the
+		         returned data
+
+   return values: <0) error/hole in data (OV_HOLE), partial open (OV_EINVAL)
+                   0) EOF
+                   n) number of bytes of PCM actually returned.  Planar
+		   data places the n/channels bytes of each channel one
+		   after the other, starting with channel 0.  The
+                   below works on a packet-by-packet basis, so the
+                   return length is not related to the 'length' passed
+                   in, just guaranteed to fit.
+
+            *section) set to the logical bitstream number */
+
+long ov_read_format(OggVorbis_File *vf,char *buffer,int length,
+		    const ov_format *format,int *bitstream){
+  ogg_int32_t **pcm;
+  long channels,samples,word;
+  int swap,planar;
+
+  if(vf->ready_state<OPENED || !format)return(OV_EINVAL);
+
+  switch(format->encoding){
+  case OV_FMT_U8:
+    word=1;
+    break;
+  case OV_FMT_S16:
+    word=2;
+    break;
+  case OV_FMT_S24:
+    word=3;
+    break;
+  case OV_FMT_S32:
+  case OV_FMT_FLOAT32:
+    word=4;
+    break;
+  default:
+    return(OV_EINVAL);
+  }
+
+  while(1){
+    if(vf->ready_state==INITSET){
+      samples=vorbis_synthesis_pcmout(&vf->vd,&pcm);
+      if(samples)break;
+    }
+
+    /* suck in another packet */
+    {
+      int ret=_fetch_and_process_packet(vf,NULL,1,1);
+      if(ret==OV_EOF)
+        return(0);
+      if(ret<=0)
+        return(ret);
+    }
+
+  }
+
+  channels=ov_info(vf,-1)->channels;
+  if(samples>length/(word*channels))
+    samples=length/(word*channels);
+  if(samples<=0)return(OV_EINVAL);
+
+  swap=(format->bigendianp!=0)!=host_is_big_endian();
+  planar=(format->planar!=0);
+
+  switch(format->encoding){
+  case OV_FMT_U8:
+    _pack_u8((unsigned char *)buffer,pcm,channels,samples,planar);
+    break;
+  case OV_FMT_S16:
+    if(swap)
+      _pack_s16x((unsigned short *)buffer,pcm,channels,samples,planar);
+    else
+      _pack_s16((unsigned short *)buffer,pcm,channels,samples,planar);
+    break;
+  case OV_FMT_S24:
+    _pack_s24((unsigned char *)buffer,pcm,channels,samples,planar,
+	      format->bigendianp!=0);
+    break;
+  case OV_FMT_S32:
+    if(swap)
+      _pack_s32x((ogg_uint32_t *)buffer,pcm,channels,samples,planar);
+    else
+      _pack_s32((ogg_uint32_t *)buffer,pcm,channels,samples,planar);
+    break;
+  case OV_FMT_FLOAT32:
+    if(swap)
+      _pack_f32x((ogg_uint32_t *)buffer,pcm,channels,samples,planar);
+    else
+      _pack_f32((float *)buffer,pcm,channels,samples,planar);
+    break;
+  }
+
+  vorbis_synthesis_read(&vf->vd,samples);
+  vf->pcm_offset+=(ogg_int64_t)samples<<_halfrate_shift(vf);
+  if(bitstream)*bitstream=vf->current_link;
+  return(samples*word*channels);
+}
@@ -18,30 +18,118 @@
 #include <stdlib.h>
 #include "misc.h"
 #include "window.h"
+
+#ifndef _GENERATED_WINDOWS_
 #include "window_lookup.h"
+#else
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* The window tables are built the first time a stream asks for one
+   rather than compiled in, and are then shared by every decoder in
+   the process.  All of them are built together, once; with threads
+   that's under pthread_once() so decoders may be set up concurrently.
+   Without HAVE_PTHREAD the library can't be entered from two threads
+   at once while the tables are built, so the first decoder set up
+   must not race another. */
+
+static LOOKUP_T vwin64[32];
+static LOOKUP_T vwin128[64];
+static LOOKUP_T vwin256[128];
+static LOOKUP_T vwin512[256];
+static LOOKUP_T vwin1024[512];
+static LOOKUP_T vwin2048[1024];
+static LOOKUP_T vwin4096[2048];
+static LOOKUP_T vwin8192[4096];
+
+/* everything below is unsigned Q61 in 64 bits */
+#define WQ     61
+#define WONE   ((ogg_int64_t)1<<WQ)
+#define WHALFPI (((ogg_int64_t)0x3243f6a8<<32)|0x885a308d)
+
+/* (a*b)>>WQ, without a 128 bit intermediate; a,b < 3<<WQ */
+static ogg_int64_t wmul(ogg_int64_t a,ogg_int64_t b){
+  ogg_int64_t a1=a>>31,a0=a&0x7fffffff;
+  ogg_int64_t b1=b>>31,b0=b&0x7fffffff;
+  ogg_int64_t mid=((a1*b0)>>1)+((a0*b1)>>1)+((a0*b0)>>32);
+  return ((a1*b1)<<1)+(mid>>29);
+}
+
+/* sin(x), 0<=x<=PI/2; the Taylor series is exhausted well below the
+   Q31 rounding point by the 27th power */
+static ogg_int64_t wsin(ogg_int64_t x){
+  ogg_int64_t x2=wmul(x,x);
+  ogg_int64_t t=WONE;
+  int k;
+  for(k=13;k>0;k--)
+    t=WONE-wmul(x2,t)/(2*k*(2*k+1));
+  return wmul(x,t);
+}
+
+/* Q31 sin(.5*PI*sin^2((i+.5)/left*.5*PI)), rounded; identical to the
+   values in window_lookup.h */
+static void _vorbis_window_build(LOOKUP_T *w,int left){
+  int i;
+  for(i=0;i<left;i++){
+    ogg_int64_t s=wsin(wmul(WONE/left/2*(2*i+1),WHALFPI));
+    ogg_int64_t v=(wsin(wmul(wmul(s,s),WHALFPI))+(1<<29))>>30;
+    if(v>0x7fffffff)v=0x7fffffff;
+    w[i]=X((ogg_int32_t)v);
+  }
+}
+
+static void _vorbis_windows_build(void){
+  _vorbis_window_build(vwin64,32);
+  _vorbis_window_build(vwin128,64);
+  _vorbis_window_build(vwin256,128);
+  _vorbis_window_build(vwin512,256);
+  _vorbis_window_build(vwin1024,512);
+  _vorbis_window_build(vwin2048,1024);
+  _vorbis_window_build(vwin4096,2048);
+  _vorbis_window_build(vwin8192,4096);
+}
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t windows_built=PTHREAD_ONCE_INIT;
+#else
+static int windows_built=0;
+#endif
+
+#endif
 
 const void *_vorbis_window(int type, int left){
+  const LOOKUP_T *w;
 
   switch(type){
   case 0:
 
     switch(left){
     case 32:
-      return vwin64;
+      w=vwin64;
+      break;
     case 64:
-      return vwin128;
+      w=vwin128;
+      break;
     case 128:
-      return vwin256;
+      w=vwin256;
+      break;
     case 256:
-      return vwin512;
+      w=vwin512;
+      break;
     case 512:
-      return vwin1024;
+      w=vwin1024;
+      break;
     case 1024:
-      return vwin2048;
+      w=vwin2048;
+      break;
     case 2048:
-      return vwin4096;
+      w=vwin4096;
+      break;
     case 4096:
-      return vwin8192;
+      w=vwin8192;
+      break;
     default:
       return(0);
     }
@@ -49,8 +137,25 @@ const void *_vorbis_window(int type, int left){
   default:
     return(0);
   }
+
+#ifdef _GENERATED_WINDOWS_
+#ifdef HAVE_PTHREAD
+  pthread_once(&windows_built,_vorbis_windows_build);
+#else
+  if(!windows_built){
+    _vorbis_windows_build();
+    windows_built=1;
+  }
+#endif
+#endif
+  return(w);
 }
 
+/* Only the window slopes are applied.  Outside [leftbegin,rightend)
+   the window is zero, but those samples are left as the transform
+   produced them rather than cleared: the overlap/add in
+   vorbis_synthesis_blockin() never reads past the nonzero extent. */
+
 void _vorbis_apply_window(ogg_int32_t *d,const void *window_p[2],
 			  long *blocksizes,
 			  int lW,int W,int nW){
@@ -71,15 +176,9 @@ void _vorbis_apply_window(ogg_int32_t *d,const void *window_p[2],
   window[0] = (const LOOKUP_T *)window_p[0];
   window[1] = (const LOOKUP_T *)window_p[1];
 
-  for(i=0;i<leftbegin;i++)
-    d[i]=0;
-
-  for(p=0;i<leftend;i++,p++)
+  for(i=leftbegin,p=0;i<leftend;i++,p++)
     d[i]=MULT31(d[i],window[lW][p]);
 
   for(i=rightbegin,p=rn/2-1;i<rightend;i++,p--)
     d[i]=MULT31(d[i],window[nW][p]);
-
-  for(;i<n;i++)
-    d[i]=0;
 }
@@ -23,5 +23,12 @@ extern void _vorbis_apply_window(ogg_int32_t *d,const void *window[2],
 				 long *blocksizes,
 				 int lW,int W,int nW);
 
+#ifndef _LOW_ACCURACY_
+extern const void *_vorbis_window_low(int type,int left);
+extern void _vorbis_apply_window_low(ogg_int32_t *d,const void *window[2],
+				     long *blocksizes,
+				     int lW,int W,int nW);
+#endif
+
 
 #endif
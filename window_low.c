@@ -0,0 +1,25 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis 'TREMOR' CODEC SOURCE CODE.   *
+ *                                                                  *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis 'TREMOR' SOURCE CODE IS (C) COPYRIGHT 1994-2002    *
+ * BY THE Xiph.Org FOUNDATION http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: low accuracy window tables and windowing
+
+ ********************************************************************/
+
+/* window.c with _LOW_ACCURACY_; see mdct_low.c */
+
+#ifndef _LOW_ACCURACY_
+#define _LOW_ACCURACY_
+#define _vorbis_window       _vorbis_window_low
+#define _vorbis_apply_window _vorbis_apply_window_low
+#include "window.c"
+#endif